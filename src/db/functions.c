@@ -0,0 +1,87 @@
+#include "functions.h"
+#include <stdlib.h>
+#include <libc/lz.h>
+#include <libc/hash.h>
+
+size_t db_compress_body(const char* body, size_t len, void** outData) {
+	*outData = NULL;
+	if (len < DB_COMPRESS_MIN_SIZE)
+		return 0;
+	// Anything saving less than an eighth is not worth decompressing later
+	size_t capacity = len - len / 8;
+	void* data = malloc(capacity);
+	size_t size = lz_compress(body, len, data, capacity);
+	if (size == 0)
+		free(data);
+	else
+		*outData = data;
+	return size;
+}
+
+int64_t db_note_hash(const char* title, size_t titleLen, const char* body, size_t bodyLen) {
+	return (int64_t)hash64(body, bodyLen, hash64(title, titleLen, 0));
+}
+
+static void local_compress(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+	if (sqlite3_value_type(argv[0]) != SQLITE_TEXT) {
+		sqlite3_result_value(ctx, argv[0]);
+		return;
+	}
+	const char* text = (const char*)sqlite3_value_text(argv[0]);
+	size_t len = (size_t)sqlite3_value_bytes(argv[0]);
+	void* data;
+	size_t size = db_compress_body(text, len, &data);
+	if (size == 0)
+		sqlite3_result_value(ctx, argv[0]);
+	else
+		sqlite3_result_blob64(ctx, data, size, free);
+}
+
+static void local_body(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+	// Bodies that did not compress are still stored as text
+	if (sqlite3_value_type(argv[0]) != SQLITE_BLOB) {
+		sqlite3_result_value(ctx, argv[0]);
+		return;
+	}
+	sqlite3_int64 size = sqlite3_value_int64(argv[1]);
+	const void* data = sqlite3_value_blob(argv[0]);
+	int len = sqlite3_value_bytes(argv[0]);
+	char* text = size >= 0 ? sqlite3_malloc64((sqlite3_uint64)size + 1) : NULL;
+	if (text == NULL) {
+		sqlite3_result_error_nomem(ctx);
+		return;
+	}
+	if (!lz_decompress(data, (size_t)len, text, (size_t)size)) {
+		sqlite3_free(text);
+		sqlite3_result_error(ctx, "corrupt compressed note body", -1);
+		return;
+	}
+	text[size] = '\0';
+	sqlite3_result_text64(ctx, text, (sqlite3_uint64)size, sqlite3_free, SQLITE_UTF8);
+}
+
+static void local_hash(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+	const char* title = (const char*)sqlite3_value_text(argv[0]);
+	size_t titleLen = (size_t)sqlite3_value_bytes(argv[0]);
+	const char* body = (const char*)sqlite3_value_text(argv[1]);
+	size_t bodyLen = (size_t)sqlite3_value_bytes(argv[1]);
+	if (title == NULL || body == NULL)
+		sqlite3_result_null(ctx);
+	else
+		sqlite3_result_int64(ctx, db_note_hash(title, titleLen, body, bodyLen));
+}
+
+int db_functions_register(sqlite3* db) {
+	const int flags = SQLITE_UTF8 | SQLITE_DETERMINISTIC | SQLITE_INNOCUOUS;
+	int res = sqlite3_create_function(db, "nc_compress", 1, flags, NULL,
+		local_compress, NULL, NULL);
+	if (res == SQLITE_OK) {
+		res = sqlite3_create_function(db, "nc_body", 2, flags, NULL,
+			local_body, NULL, NULL);
+	}
+	if (res == SQLITE_OK) {
+		res = sqlite3_create_function(db, "nc_hash", 2, flags, NULL,
+			local_hash, NULL, NULL);
+	}
+	return res;
+}
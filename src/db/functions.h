@@ -0,0 +1,35 @@
+#ifndef DB_FUNCTIONS_H
+#define DB_FUNCTIONS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <ext/sqlite3.h>
+
+/* Bodies shorter than this are always stored as plain text */
+#define DB_COMPRESS_MIN_SIZE	128
+
+/******************************************************************************\
+* Register the application SQL functions on a connection, every connection
+* that reads note bodies or writes to the search index needs them
+*   nc_compress(text)  The compressed BLOB, or the text if it does not shrink
+*   nc_body(body, size) The text of a body stored by nc_compress, where size
+*                      is the length of the original text in bytes
+*   nc_hash(title, body) The content hash of a note, see db_note_hash
+* Returns:   SQLITE_OK on success, otherwise the SQLite error code
+\******************************************************************************/
+int db_functions_register(sqlite3* db);
+
+/******************************************************************************\
+* Compress a body into a buffer from malloc when it shrinks enough to be worth
+* storing compressed
+* Returns:   The compressed size, or 0 (with nothing to free) to store as text
+\******************************************************************************/
+size_t db_compress_body(const char* body, size_t len, void** outData);
+
+/******************************************************************************\
+* Hash a note's title and text in one pass, notes with equal hashes are
+* treated as duplicates. The result is stored as a signed SQLite integer
+\******************************************************************************/
+int64_t db_note_hash(const char* title, size_t titleLen, const char* body, size_t bodyLen);
+
+#endif
@@ -0,0 +1,37 @@
+#include "profile.h"
+#include <stddef.h>
+#include <db/query.h>
+#include <libc/string.h>
+
+#define JOURNAL_FORMAT	"PRAGMA journal_mode=%s;"
+#define PROFILE_FORMAT	"PRAGMA synchronous=%s; PRAGMA temp_store=%s; " \
+	"PRAGMA cache_size=-%lld; PRAGMA mmap_size=%lld; PRAGMA wal_autocheckpoint=%d;"
+
+static const DbProfile s_profiles[] = {
+	// WAL lets the worker read while imports write, mmap keeps reads out of
+	// the page cache and NORMAL only syncs at checkpoints
+	{ DB_PROFILE_INTERACTIVE, "WAL", "NORMAL", "MEMORY",
+		16 * 1024, 256LL * 1024 * 1024, 1000 },
+	// Nothing is synced and the WAL is left to grow until the load is over
+	{ DB_PROFILE_BULK_LOAD, "WAL", "OFF", "MEMORY",
+		256 * 1024, 256LL * 1024 * 1024, 0 },
+	// Large read mostly databases, every commit is synced
+	{ DB_PROFILE_ARCHIVE, "WAL", "FULL", "DEFAULT",
+		4 * 1024, 1024LL * 1024 * 1024, 1000 },
+};
+
+const DbProfile* db_profile_find(const char* name) {
+	for (size_t i = 0; i < sizeof(s_profiles) / sizeof(*s_profiles); ++i) {
+		if (streqi(s_profiles[i].name, name))
+			return &s_profiles[i];
+	}
+	return NULL;
+}
+
+int db_profile_apply(sqlite3* db, const DbProfile* profile, bool journal) {
+	if (journal && query_run(db, JOURNAL_FORMAT, profile->journalMode) != QUERY_OK)
+		return QUERY_ERR;
+	return query_run(db, PROFILE_FORMAT, profile->synchronous, profile->tempStore,
+		(long long)profile->cacheKiB, (long long)profile->mmapSize,
+		profile->walAutoCheckpoint);
+}
@@ -0,0 +1,40 @@
+#ifndef DB_PROFILE_H
+#define DB_PROFILE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <ext/sqlite3.h>
+
+#define DB_PROFILE_INTERACTIVE	"interactive"
+#define DB_PROFILE_BULK_LOAD	"bulk-load"
+#define DB_PROFILE_ARCHIVE		"archive"
+
+/******************************************************************************\
+* A named set of storage PRAGMAs. The journal mode is stored in the database
+* file while the rest only last as long as the connection
+\******************************************************************************/
+typedef struct {
+	const char* name;
+	const char* journalMode;
+	const char* synchronous;
+	const char* tempStore;
+	int64_t cacheKiB;
+	int64_t mmapSize;
+	int32_t walAutoCheckpoint;
+} DbProfile;
+
+/******************************************************************************\
+* Look up a built in profile by name (case insensitive)
+* Returns:   The profile or NULL if there is no profile with that name
+\******************************************************************************/
+const DbProfile* db_profile_find(const char* name);
+
+/******************************************************************************\
+* Apply the profile to an open connection. The journal mode can only change
+* outside of a transaction while no other connection is open, so it is left
+* alone unless journal is true
+* Returns:   QUERY_OK on success, otherwise QUERY_ERR
+\******************************************************************************/
+int db_profile_apply(sqlite3* db, const DbProfile* profile, bool journal);
+
+#endif
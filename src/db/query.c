@@ -1,7 +1,25 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <db/query.h>
+#include <libc/string.h>
+
+#define QUERY_CACHE_START_CAPACITY	32
+
+typedef struct {
+	uint32_t hash;
+	char* sql;
+	sqlite3_stmt* stmt;
+} QueryCacheEntry;
+
+struct QueryCache {
+	sqlite3* db;
+	QueryCacheEntry* entries;
+	uint32_t capacity;
+	uint32_t count;
+};
 
 int query_run(sqlite3* db, const char* format, ...) {
 	char query[1024];
@@ -13,6 +31,18 @@ int query_run(sqlite3* db, const char* format, ...) {
 	int res = sqlite3_exec(db, query, NULL, NULL, &err);
 	if (res == SQLITE_ABORT || err != NULL) {
 		// TODO:  Log the err
+		sqlite3_free(err);
+		return QUERY_ERR;
+	}
+	return QUERY_OK;
+}
+
+int query_exec(sqlite3* db, const char* sql) {
+	char* err = NULL;
+	int res = sqlite3_exec(db, sql, NULL, NULL, &err);
+	if (res != SQLITE_OK || err != NULL) {
+		// TODO:  Log the err
+		sqlite3_free(err);
 		return QUERY_ERR;
 	}
 	return QUERY_OK;
@@ -31,7 +61,144 @@ int query_run_cb(sqlite3* db, int (*callback)(void*, int, char**, char**),
 	if (res == SQLITE_ABORT || err != NULL) {
 		// TODO:  Log the err
 		//printf("%s", sqlite3_errstr(res));
+		sqlite3_free(err);
 		return QUERY_ERR;
 	}
 	return QUERY_OK;
 }
+
+/************************************************************************/
+/************************************************************************/
+/* Statement cache                                                      */
+/************************************************************************/
+/************************************************************************/
+static inline uint32_t local_sql_hash(const char* sql) {
+	// FNV-1a, the SQL strings are short and only hashed on lookup
+	uint32_t hash = 2166136261u;
+	for (; *sql != '\0'; ++sql) {
+		hash ^= (unsigned char)*sql;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static QueryCacheEntry* local_cache_find(QueryCacheEntry* entries,
+	uint32_t capacity, uint32_t hash, const char* sql)
+{
+	uint32_t idx = hash & (capacity - 1);
+	while (entries[idx].sql != NULL) {
+		if (entries[idx].hash == hash && strcmp(entries[idx].sql, sql) == 0)
+			break;
+		idx = (idx + 1) & (capacity - 1);
+	}
+	return &entries[idx];
+}
+
+static void local_cache_grow(QueryCache* cache) {
+	uint32_t capacity = cache->capacity * 2;
+	QueryCacheEntry* entries = calloc(capacity, sizeof(*entries));
+	for (uint32_t i = 0; i < cache->capacity; ++i) {
+		QueryCacheEntry* from = &cache->entries[i];
+		if (from->sql != NULL)
+			*local_cache_find(entries, capacity, from->hash, from->sql) = *from;
+	}
+	free(cache->entries);
+	cache->entries = entries;
+	cache->capacity = capacity;
+}
+
+QueryCache* query_cache_new(sqlite3* db) {
+	QueryCache* cache = calloc(1, sizeof(*cache));
+	cache->db = db;
+	cache->capacity = QUERY_CACHE_START_CAPACITY;
+	cache->entries = calloc(cache->capacity, sizeof(*cache->entries));
+	return cache;
+}
+
+void query_cache_free(QueryCache* cache) {
+	for (uint32_t i = 0; i < cache->capacity; ++i) {
+		sqlite3_finalize(cache->entries[i].stmt);
+		free(cache->entries[i].sql);
+	}
+	free(cache->entries);
+	free(cache);
+}
+
+sqlite3_stmt* query_cache_get(QueryCache* cache, const char* sql) {
+	uint32_t hash = local_sql_hash(sql);
+	QueryCacheEntry* entry = local_cache_find(cache->entries, cache->capacity, hash, sql);
+	if (entry->sql != NULL) {
+		sqlite3_reset(entry->stmt);
+		sqlite3_clear_bindings(entry->stmt);
+		return entry->stmt;
+	}
+	sqlite3_stmt* stmt = NULL;
+	if (sqlite3_prepare_v3(cache->db, sql, -1,
+		SQLITE_PREPARE_PERSISTENT, &stmt, NULL) != SQLITE_OK)
+	{
+		sqlite3_finalize(stmt);
+		return NULL;
+	}
+	if ((cache->count + 1) * 4 > cache->capacity * 3) {
+		local_cache_grow(cache);
+		entry = local_cache_find(cache->entries, cache->capacity, hash, sql);
+	}
+	entry->hash = hash;
+	entry->stmt = stmt;
+	strclone(sql, &entry->sql);
+	cache->count++;
+	return stmt;
+}
+
+int query_cache_exec(QueryCache* cache, const char* sql) {
+	sqlite3_stmt* stmt = query_cache_get(cache, sql);
+	if (stmt == NULL)
+		return QUERY_ERR;
+	int res;
+	while ((res = query_step(stmt)) == QUERY_ROW) {}
+	query_done(stmt);
+	return res;
+}
+
+int query_bind_int(sqlite3_stmt* stmt, int idx, int32_t value) {
+	return sqlite3_bind_int(stmt, idx, value) == SQLITE_OK ? QUERY_OK : QUERY_ERR;
+}
+
+int query_bind_int64(sqlite3_stmt* stmt, int idx, int64_t value) {
+	return sqlite3_bind_int64(stmt, idx, value) == SQLITE_OK ? QUERY_OK : QUERY_ERR;
+}
+
+int query_bind_double(sqlite3_stmt* stmt, int idx, double value) {
+	return sqlite3_bind_double(stmt, idx, value) == SQLITE_OK ? QUERY_OK : QUERY_ERR;
+}
+
+int query_bind_text(sqlite3_stmt* stmt, int idx, const char* text, int64_t len) {
+	if (len < 0)
+		len = (int64_t)strlen(text);
+	return sqlite3_bind_text64(stmt, idx, text, (sqlite3_uint64)len,
+		SQLITE_STATIC, SQLITE_UTF8) == SQLITE_OK ? QUERY_OK : QUERY_ERR;
+}
+
+int query_bind_blob(sqlite3_stmt* stmt, int idx, const void* blob, int64_t len) {
+	return sqlite3_bind_blob64(stmt, idx, blob, (sqlite3_uint64)len,
+		SQLITE_STATIC) == SQLITE_OK ? QUERY_OK : QUERY_ERR;
+}
+
+int query_bind_null(sqlite3_stmt* stmt, int idx) {
+	return sqlite3_bind_null(stmt, idx) == SQLITE_OK ? QUERY_OK : QUERY_ERR;
+}
+
+int query_step(sqlite3_stmt* stmt) {
+	switch (sqlite3_step(stmt)) {
+		case SQLITE_ROW:
+			return QUERY_ROW;
+		case SQLITE_DONE:
+			return QUERY_OK;
+		default:
+			return QUERY_ERR;
+	}
+}
+
+void query_done(sqlite3_stmt* stmt) {
+	sqlite3_reset(stmt);
+}
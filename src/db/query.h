@@ -1,17 +1,75 @@
 #ifndef DB_QUERY_H
 #define DB_QUERY_H
 
+#include <stdint.h>
 #include <ext/sqlite3.h>
 
 #define QUERY_OK	0
 #define QUERY_ERR	1
+#define QUERY_ROW	2
+
+// How long (ms) every connection waits on a lock held by another connection
+#define DB_BUSY_TIMEOUT	5000
 
 #define querycbtype(stateType, db, cb, state, format, ...)	\
 	((int(*)(sqlite3*, int (*)(stateType, int, char**, char**), stateType, const char*, ...))query_run_cb) \
 	(db, cb, state, format, __VA_ARGS__)
 
+typedef struct QueryCache QueryCache;
+
 int query_run(sqlite3* db, const char* format, ...);
+int query_exec(sqlite3* db, const char* sql);
 int query_run_cb(sqlite3* db, int (*callback)(void*, int, char**, char**),
 	void* state, const char* format, ...);
 
-#endif
\ No newline at end of file
+/******************************************************************************\
+* Creates a prepared statement cache for the given connection. Statements are
+* keyed by their SQL text and are only compiled the first time they are used
+\******************************************************************************/
+QueryCache* query_cache_new(sqlite3* db);
+
+/******************************************************************************\
+* Finalizes every cached statement, must be called before closing the database
+\******************************************************************************/
+void query_cache_free(QueryCache* cache);
+
+/******************************************************************************\
+* Get the cached statement for the SQL text (compiling it on first use). The
+* statement is reset and has its bindings cleared, ready to be bound again
+* Returns:   The statement or NULL if the SQL failed to compile
+\******************************************************************************/
+sqlite3_stmt* query_cache_get(QueryCache* cache, const char* sql);
+
+/******************************************************************************\
+* Run a cached statement that takes no parameters to completion
+* Returns:   QUERY_OK on success, otherwise QUERY_ERR
+\******************************************************************************/
+int query_cache_exec(QueryCache* cache, const char* sql);
+
+/******************************************************************************\
+* Typed binding helpers, text and blobs are bound without being copied so the
+* memory must live until the statement is stepped and reset. A negative text
+* length means the text is NUL terminated
+* Returns:   QUERY_OK on success, otherwise QUERY_ERR
+\******************************************************************************/
+int query_bind_int(sqlite3_stmt* stmt, int idx, int32_t value);
+int query_bind_int64(sqlite3_stmt* stmt, int idx, int64_t value);
+int query_bind_double(sqlite3_stmt* stmt, int idx, double value);
+int query_bind_text(sqlite3_stmt* stmt, int idx, const char* text, int64_t len);
+int query_bind_blob(sqlite3_stmt* stmt, int idx, const void* blob, int64_t len);
+int query_bind_null(sqlite3_stmt* stmt, int idx);
+
+/******************************************************************************\
+* Step the statement once
+* Returns:   QUERY_ROW when a row is ready, QUERY_OK when the statement has
+*            finished, otherwise QUERY_ERR
+\******************************************************************************/
+int query_step(sqlite3_stmt* stmt);
+
+/******************************************************************************\
+* Release a cached statement once the caller is done reading from it so that
+* it does not hold its read transaction open until its next use
+\******************************************************************************/
+void query_done(sqlite3_stmt* stmt);
+
+#endif
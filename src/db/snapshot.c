@@ -0,0 +1,64 @@
+#include "snapshot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Bytes 18 and 19 of the header are the file format write and read versions,
+// 2 marks a WAL database, which an in-memory image can not open
+#define DB_HEADER_WRITE_VERSION	18
+#define DB_HEADER_READ_VERSION	19
+#define DB_HEADER_ROLLBACK		1
+
+static inline double local_now() {
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0;
+}
+
+DbSnapshot* db_snapshot_new(sqlite3* db) {
+	double start = local_now();
+	sqlite3_int64 size = 0;
+	unsigned char* image = sqlite3_serialize(db, "main", &size, 0);
+	if (image == NULL)
+		return NULL;
+	if (size > DB_HEADER_READ_VERSION) {
+		image[DB_HEADER_WRITE_VERSION] = DB_HEADER_ROLLBACK;
+		image[DB_HEADER_READ_VERSION] = DB_HEADER_ROLLBACK;
+	}
+	DbSnapshot* snapshot = calloc(1, sizeof(*snapshot));
+	snapshot->image = image;
+	snapshot->size = size;
+	snapshot->loadSeconds = local_now() - start;
+	return snapshot;
+}
+
+void db_snapshot_free(DbSnapshot* snapshot) {
+	sqlite3_free(snapshot->image);
+	free(snapshot);
+}
+
+bool db_snapshot_open(const DbSnapshot* snapshot, sqlite3** outDb) {
+	*outDb = NULL;
+	sqlite3* db;
+	if (sqlite3_open_v2(":memory:", &db, SQLITE_OPEN_READWRITE, NULL) != SQLITE_OK) {
+		sqlite3_close(db);
+		return false;
+	}
+	// Without FREEONCLOSE or RESIZEABLE the image is used in place, not copied
+	int rc = sqlite3_deserialize(db, "main", snapshot->image,
+		snapshot->size, snapshot->size, SQLITE_DESERIALIZE_READONLY);
+	if (rc == SQLITE_OK) {
+		// Mapping the whole image lets pages be read without copying them
+		char sql[64];
+		snprintf(sql, sizeof(sql), "PRAGMA mmap_size=%lld", (long long)snapshot->size);
+		rc = sqlite3_exec(db, sql, NULL, NULL, NULL);
+	}
+	if (rc == SQLITE_OK)
+		rc = sqlite3_exec(db, "PRAGMA temp_store=MEMORY", NULL, NULL, NULL);
+	if (rc != SQLITE_OK) {
+		sqlite3_close(db);
+		return false;
+	}
+	*outDb = db;
+	return true;
+}
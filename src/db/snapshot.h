@@ -0,0 +1,39 @@
+#ifndef DB_SNAPSHOT_H
+#define DB_SNAPSHOT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <ext/sqlite3.h>
+
+/******************************************************************************\
+* A read only copy of a whole database held in memory. Any number of
+* connections (on any thread) can be opened over the one image, none of them
+* ever reads from or writes to the disk
+\******************************************************************************/
+typedef struct {
+	unsigned char* image;
+	int64_t size;
+	double loadSeconds;
+} DbSnapshot;
+
+/******************************************************************************\
+* Copy the main database of an open connection into memory, pages still in
+* the WAL are included
+* Returns:   The snapshot or NULL if the database could not be serialized
+\******************************************************************************/
+DbSnapshot* db_snapshot_new(sqlite3* db);
+
+/******************************************************************************\
+* Free the image, every connection opened over it must be closed first
+\******************************************************************************/
+void db_snapshot_free(DbSnapshot* snapshot);
+
+/******************************************************************************\
+* Open a read only connection that serves pages straight out of the image
+* with sqlite3_deserialize, temporary tables and sorts are kept in memory too
+* Returns:   False if the connection could not be opened
+* Parameter: outDb The new connection, close it with sqlite3_close
+\******************************************************************************/
+bool db_snapshot_open(const DbSnapshot* snapshot, sqlite3** outDb);
+
+#endif
@@ -0,0 +1,175 @@
+#include "worker.h"
+#include <stdlib.h>
+#include <threads.h>
+#include <stdatomic.h>
+#include <db/functions.h>
+
+#define DB_WORKER_QUEUE_SIZE	64	/* Must be a power of 2 */
+
+/* Single producer, single consumer ring of jobs */
+typedef struct {
+	DbJob* jobs[DB_WORKER_QUEUE_SIZE];
+	atomic_size_t head;
+	atomic_size_t tail;
+} DbJobRing;
+
+struct DbWorker {
+	sqlite3* db;
+	QueryCache* queries;
+	thrd_t thread;
+	mtx_t lock;
+	cnd_t wake;
+	DbJobRing submitted;
+	DbJobRing completed;
+	atomic_uint generation;
+	atomic_bool running;
+	atomic_bool stop;
+	int pending;
+};
+
+static bool local_ring_push(DbJobRing* ring, DbJob* job) {
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+	if (tail - head == DB_WORKER_QUEUE_SIZE)
+		return false;
+	ring->jobs[tail & (DB_WORKER_QUEUE_SIZE - 1)] = job;
+	atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+	return true;
+}
+
+static DbJob* local_ring_pop(DbJobRing* ring) {
+	size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+	if (head == tail)
+		return NULL;
+	DbJob* job = ring->jobs[head & (DB_WORKER_QUEUE_SIZE - 1)];
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+	return job;
+}
+
+static inline bool local_is_current(DbWorker* worker, DbJob* job) {
+	return job->generation == atomic_load(&worker->generation);
+}
+
+static int local_worker_main(void* arg) {
+	DbWorker* worker = arg;
+	while (!atomic_load(&worker->stop)) {
+		DbJob* job = local_ring_pop(&worker->submitted);
+		if (job == NULL) {
+			mtx_lock(&worker->lock);
+			while (!atomic_load(&worker->stop)
+				&& atomic_load(&worker->submitted.head) == atomic_load(&worker->submitted.tail))
+			{
+				cnd_wait(&worker->wake, &worker->lock);
+			}
+			mtx_unlock(&worker->lock);
+			continue;
+		}
+		job->cancelled = !local_is_current(worker, job);
+		if (!job->cancelled) {
+			atomic_store(&worker->running, true);
+			job->run(job, worker->db, worker->queries);
+			atomic_store(&worker->running, false);
+			// An interrupt meant for the previous job can land on this one if
+			// it started right after the cancel, so a current job gets a retry
+			if (job->cancelled && local_is_current(worker, job)) {
+				job->cancelled = false;
+				atomic_store(&worker->running, true);
+				job->run(job, worker->db, worker->queries);
+				atomic_store(&worker->running, false);
+			}
+			job->cancelled = job->cancelled || !local_is_current(worker, job);
+		}
+		// The completed ring is as large as the submitted one and the
+		// poller drains it, so this only spins if the UI stops polling
+		while (!local_ring_push(&worker->completed, job))
+			thrd_yield();
+	}
+	return 0;
+}
+
+DbWorker* db_worker_new(const char* path, const DbSnapshot* snapshot, const DbProfile* profile) {
+	DbWorker* worker = calloc(1, sizeof(*worker));
+	if (snapshot != NULL) {
+		if (!db_snapshot_open(snapshot, &worker->db)) {
+			free(worker);
+			return NULL;
+		}
+	} else if (sqlite3_open_v2(path, &worker->db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+		sqlite3_close(worker->db);
+		free(worker);
+		return NULL;
+	}
+	sqlite3_busy_timeout(worker->db, DB_BUSY_TIMEOUT);
+	db_functions_register(worker->db);
+	if (profile != NULL && snapshot == NULL)
+		db_profile_apply(worker->db, profile, false);
+	worker->queries = query_cache_new(worker->db);
+	mtx_init(&worker->lock, mtx_plain);
+	cnd_init(&worker->wake);
+	if (thrd_create(&worker->thread, local_worker_main, worker) != thrd_success) {
+		query_cache_free(worker->queries);
+		sqlite3_close(worker->db);
+		mtx_destroy(&worker->lock);
+		cnd_destroy(&worker->wake);
+		free(worker);
+		return NULL;
+	}
+	return worker;
+}
+
+void db_worker_free(DbWorker* worker) {
+	db_worker_cancel(worker);
+	mtx_lock(&worker->lock);
+	atomic_store(&worker->stop, true);
+	cnd_signal(&worker->wake);
+	mtx_unlock(&worker->lock);
+	thrd_join(worker->thread, NULL);
+	DbJob* job;
+	while ((job = local_ring_pop(&worker->completed)) != NULL) {
+		job->cancelled = true;
+		job->done(job);
+	}
+	while ((job = local_ring_pop(&worker->submitted)) != NULL) {
+		job->cancelled = true;
+		job->done(job);
+	}
+	query_cache_free(worker->queries);
+	sqlite3_close(worker->db);
+	mtx_destroy(&worker->lock);
+	cnd_destroy(&worker->wake);
+	free(worker);
+}
+
+bool db_worker_submit(DbWorker* worker, DbJob* job) {
+	job->generation = atomic_load(&worker->generation);
+	job->cancelled = false;
+	if (!local_ring_push(&worker->submitted, job))
+		return false;
+	worker->pending++;
+	mtx_lock(&worker->lock);
+	cnd_signal(&worker->wake);
+	mtx_unlock(&worker->lock);
+	return true;
+}
+
+void db_worker_cancel(DbWorker* worker) {
+	atomic_fetch_add(&worker->generation, 1);
+	if (atomic_load(&worker->running))
+		sqlite3_interrupt(worker->db);
+}
+
+int db_worker_poll(DbWorker* worker) {
+	int count = 0;
+	DbJob* job;
+	while ((job = local_ring_pop(&worker->completed)) != NULL) {
+		worker->pending--;
+		count++;
+		job->done(job);
+	}
+	return count;
+}
+
+bool db_worker_busy(const DbWorker* worker) {
+	return worker->pending > 0;
+}
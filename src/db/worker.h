@@ -0,0 +1,63 @@
+#ifndef DB_WORKER_H
+#define DB_WORKER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <db/query.h>
+#include <db/profile.h>
+#include <db/snapshot.h>
+#include <ext/sqlite3.h>
+
+typedef struct DbJob DbJob;
+typedef struct DbWorker DbWorker;
+
+/******************************************************************************\
+* A unit of database work. run is called on the worker thread with the worker's
+* own connection, done is called later on the thread that polls the worker.
+* When cancelled is set run may not have finished (or even started) and the
+* job should only be cleaned up
+\******************************************************************************/
+struct DbJob {
+	void (*run)(DbJob* job, sqlite3* db, QueryCache* queries);
+	void (*done)(DbJob* job);
+	uint32_t generation;
+	bool cancelled;
+};
+
+/******************************************************************************\
+* Start a worker thread with its own read only connection to the database, or
+* to the snapshot when it is not NULL. The connection settings of the profile
+* are applied to database connections when it is not NULL
+* Returns:   The worker or NULL if the database could not be opened
+\******************************************************************************/
+DbWorker* db_worker_new(const char* path, const DbSnapshot* snapshot, const DbProfile* profile);
+
+/******************************************************************************\
+* Cancel outstanding work, stop the thread and close its connection. The done
+* callback of every job still held by the worker is called as cancelled
+\******************************************************************************/
+void db_worker_free(DbWorker* worker);
+
+/******************************************************************************\
+* Queue a job without blocking
+* Returns:   False if the queue is full
+\******************************************************************************/
+bool db_worker_submit(DbWorker* worker, DbJob* job);
+
+/******************************************************************************\
+* Cancel every job submitted so far, the running statement is interrupted
+\******************************************************************************/
+void db_worker_cancel(DbWorker* worker);
+
+/******************************************************************************\
+* Call done for every finished job on the calling thread
+* Returns:   The number of jobs delivered
+\******************************************************************************/
+int db_worker_poll(DbWorker* worker);
+
+/******************************************************************************\
+* Returns:   True while submitted jobs have not been delivered by a poll
+\******************************************************************************/
+bool db_worker_busy(const DbWorker* worker);
+
+#endif
@@ -10,7 +10,7 @@ void display_init()
 {
 #ifdef NCURSES
 	initscr();
-	halfdelay(10);	/* 1 second */
+	halfdelay(DISPLAY_INPUT_DELAY);
 	noecho();
 	keypad(stdscr, TRUE);
 #else
@@ -231,6 +231,28 @@ void display_delete_char_at(const int y, const int x)
 #endif
 }
 
+void display_set_highlight(bool on)
+{
+#ifdef NCURSES
+	if (on)
+		attron(A_STANDOUT);
+	else
+		attroff(A_STANDOUT);
+#else
+	WORD attributes = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE;
+	if (on)
+		attributes = BACKGROUND_RED | BACKGROUND_GREEN | BACKGROUND_BLUE;
+	SetConsoleTextAttribute(cmdwin(), attributes);
+#endif
+}
+
+void display_set_input_delay(int tenths)
+{
+#ifdef NCURSES
+	halfdelay(tenths);
+#endif
+}
+
 #ifndef NCURSES
 void DISPLAY_PRINT_STR(const char* format, ...)
 {
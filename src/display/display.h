@@ -2,6 +2,7 @@
 #define LTTP_CLIENT_DISPLAY_H
 
 #include <stdint.h>
+#include <stdbool.h>
 #if !defined(_WIN32) && !defined(_WIN64)
 #include <ncurses.h>
 //http://tldp.org/HOWTO/NCURSES-Programming-HOWTO/
@@ -18,6 +19,7 @@
 #define DKEY_CTRL_LEFT_ARROW	545
 #define DKEY_CTRL_RIGHT_ARROW	560
 #define DKEY_RETURN				10
+#define DKEY_TAB				9
 #define DKEY_DELETE				8
 #define DKEY_BACKSPACE			KEY_BACKSPACE
 #else
@@ -38,6 +40,7 @@
 #define DKEY_CTRL_LEFT_ARROW	499
 #define DKEY_CTRL_RIGHT_ARROW	500
 #define DKEY_RETURN				13
+#define DKEY_TAB				9
 #define DKEY_DELETE				467
 #define DKEY_BACKSPACE			8
 #define DKEY_F2					60
@@ -45,6 +48,8 @@ static inline HWND cmdwin() { return GetStdHandle(STD_OUTPUT_HANDLE); }
 static inline HWND cmdwinin() { return GetStdHandle(STD_INPUT_HANDLE); }
 #endif
 
+#define DISPLAY_INPUT_DELAY		10	/* Tenths of a second display_get_char waits */
+
 void display_init();
 void display_quit();
 void display_clear();
@@ -59,6 +64,8 @@ void display_insert_line();
 void display_delete_line();
 void display_delete_char();
 void display_delete_char_at(int y, int x);
+void display_set_highlight(bool on);
+void display_set_input_delay(int tenths);
 
 #ifdef NCURSES
 #define DISPLAY_PRINT_STR(format, ...) printw((format), __VA_ARGS__)
@@ -7,6 +7,7 @@ typedef struct TextInput TextInput;
 typedef struct {
 	TextInput* command;
 	ClientUI* ui;
+	int key;	/* Last key read, ERR when the read timed out */
 } InputState;
 
 #endif
\ No newline at end of file
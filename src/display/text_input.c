@@ -54,6 +54,7 @@ static inline void local_write_letter(TextInput* input, int c) {
 bool text_input_read(InputState* state, int match) {
 	TextInput* input = state->command;
 	int c = display_get_char();
+	state->key = c;
 	if (c != ERR) {
 		if (c == match) {
 			input->buffer[input->endIndex] = '\0';
@@ -143,6 +144,8 @@ bool text_input_read(InputState* state, int match) {
 				case DKEY_RETURN:
 					local_write_letter(input, '\n');
 					break;
+				case DKEY_TAB:
+					break;
 				case DKEY_DELETE:
 				case DKEY_BACKSPACE:
 					if (input->writeIndex > 0) {
@@ -188,3 +191,14 @@ size_t text_input_get_len(const TextInput* input) {
 void text_input_clear(TextInput* input) {
 	input->buffer[0] = '\0';
 }
+
+void text_input_set(TextInput* input, const char* text) {
+	size_t len = strlen(text);
+	if (len > input->maxLen - 1)
+		len = input->maxLen - 1;
+	memcpy(input->buffer, text, len);
+	input->buffer[len] = '\0';
+	input->endIndex = len;
+	input->writeIndex = len;
+	input->lines = 0;
+}
@@ -15,5 +15,6 @@ bool text_input_read(InputState* state, int match);
 const char* text_input_get_buffer(const TextInput* input);
 size_t text_input_get_len(const TextInput* input);
 void text_input_clear(TextInput* input);
+void text_input_set(TextInput* input, const char* text);
 
 #endif
\ No newline at end of file
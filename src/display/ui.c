@@ -24,6 +24,7 @@ typedef struct {
 	int32_t currentPageIndex;
 	int32_t pages;
 	int32_t writeIndex;
+	int32_t writeRows;
 } PageBook;
 
 static void local_clear_book(PageBook* book)
@@ -46,7 +47,27 @@ static void local_print_page(PageBuffer* page)
 	int fromX, fromY;
 	display_get_yx(&fromY, &fromX);
 	display_move(0, 0);
-	DISPLAY_PRINT_STR("%s", page->buffer);
+	bool highlight = false;
+	const char* text = page->buffer;
+	while (*text != '\0')
+	{
+		size_t len = strcspn(text, highlight
+			? UI_HIGHLIGHT_START UI_HIGHLIGHT_END "\n"
+			: UI_HIGHLIGHT_START UI_HIGHLIGHT_END);
+		if (len > 0)
+			DISPLAY_PRINT_STR("%.*s", (int)len, text);
+		text += len;
+		if (*text == '\0')
+			break;
+		bool on = *text == UI_HIGHLIGHT_START[0];
+		if (on != highlight)
+			display_set_highlight(on);
+		highlight = on;
+		if (*text != '\n')
+			text++;
+	}
+	if (highlight)
+		display_set_highlight(false);
 	display_move(fromY, fromX);
 }
 
@@ -54,6 +75,7 @@ static void local_add_page_to_book(PageBook* book, const int32_t size)
 {
 	book->tail->buffer[book->writeIndex] = '\0';
 	book->writeIndex = 0;
+	book->writeRows = 0;
 	book->tail->next = calloc(1, sizeof(PageBuffer));
 	book->tail->next->buffer = malloc(size);
 	book->tail->next->prev = book->tail;
@@ -64,18 +86,17 @@ static void local_add_page_to_book(PageBook* book, const int32_t size)
 static void local_add_to_book(PageBook* book, const char* text,
 	const int32_t rows, const int32_t cols)
 {
-	int currentRows = 0;
 	const int32_t printLen = (int32_t)strlen(text);
 	int32_t nextSpace = stridxof(text, " \0", 0);
 	int32_t lineOffset = book->writeIndex;
 	const int32_t bufferSize = rows * cols;
-	for (int32_t i = 0, pi = 0; i < printLen; ++i, ++pi)
+	for (int32_t i = 0; i < printLen; ++i)
 	{
 		char c = text[i];
 		if (c == '\n')
 		{
 			lineOffset = i + 1;
-			currentRows++;
+			book->writeRows++;
 		}
 		if (i == nextSpace)
 		{
@@ -84,17 +105,18 @@ static void local_add_to_book(PageBook* book, const char* text,
 			if (nextSpace > 0 && nextSpace - lineOffset > cols)
 			{
 				lineOffset = lastSpace + 1;
-				currentRows++;
+				book->writeRows++;
 				c = '\n';
 			}
 		}
-		if (pi == bufferSize - 1 || currentRows == rows)
+		if (book->writeIndex == bufferSize - 1 || book->writeRows == rows)
 		{
 			local_add_page_to_book(book, rows * cols);
-			currentRows = 0;
 			if (c != '\n')
+			{
 				nextSpace = stridxof(text, " \0", i + 1);
-			pi = 0;
+				book->tail->buffer[book->writeIndex++] = c;
+			}
 		}
 		else
 			book->tail->buffer[book->writeIndex++] = c;
@@ -108,6 +130,7 @@ static void local_reset_book(PageBook* book, const int32_t pageSize)
 	book->pages = 1;
 	book->currentPageIndex = 1;
 	book->writeIndex = 0;
+	book->writeRows = 0;
 	book->head = calloc(1, sizeof(PageBuffer));
 	book->head->buffer = malloc(pageSize);
 	book->head->buffer[0] = '\0';
@@ -161,6 +184,10 @@ static void local_test_book()
 /************************************************************************/
 struct ClientUI {
 	PageBook* book;
+	UIPageSource source;
+	void* sourceState;
+	bool sourcePending;
+	bool sourceWanted;
 	int32_t rows;
 	int32_t cols;
 	int writeX;
@@ -195,6 +222,44 @@ void ui_print_wrap(ClientUI* ui, const char* text)
 	display_move(fromY, fromX);
 }
 
+void ui_append(ClientUI* ui, const char* text)
+{
+	local_add_to_book(ui->book, text, ui->rows, ui->cols);
+}
+
+void ui_set_page_source(ClientUI* ui, UIPageSource source, void* state)
+{
+	ui->source = source;
+	ui->sourceState = state;
+	ui->sourcePending = false;
+	ui->sourceWanted = false;
+}
+
+bool ui_page_source_pending(const ClientUI* ui)
+{
+	return ui->sourcePending;
+}
+
+void ui_page_source_done(ClientUI* ui, bool more)
+{
+	ui->sourcePending = false;
+	if (!more)
+		ui->source = NULL;
+	if (ui->sourceWanted)
+	{
+		ui->sourceWanted = false;
+		ui_page_next(ui);
+	}
+	else
+		local_print_info_bar(ui);
+}
+
+void ui_page_source_cancel(ClientUI* ui)
+{
+	ui->sourcePending = false;
+	ui->sourceWanted = false;
+}
+
 void ui_print_command_prompt(ClientUI* ui, struct TextInput* command, const char* prefix, const char* separator)
 {
 	int rows, cols;
@@ -211,6 +276,20 @@ void ui_print_command_prompt(ClientUI* ui, struct TextInput* command, const char
 
 void ui_page_next(ClientUI* ui)
 {
+	// The tail page may still be partially filled, so more is requested
+	// until the page being moved to is complete or the source runs dry. The
+	// move happens once ui_page_source_done reports the new window
+	if (ui->source != NULL && (ui->book->currentPage->next == NULL
+		|| ui->book->currentPage->next == ui->book->tail))
+	{
+		ui->sourceWanted = true;
+		if (!ui->sourcePending)
+		{
+			ui->sourcePending = true;
+			ui->source(ui->sourceState, ui);
+		}
+		return;
+	}
 	// TODO:  Fix copy/paste
 	if (ui->book->currentPage->next == NULL)
 		return;
@@ -245,6 +324,9 @@ void ui_clear_and_print(ClientUI* ui, const char* text)
 {
 	display_clear();
 	display_move(0, 0);
+	ui->source = NULL;
+	ui->sourcePending = false;
+	ui->sourceWanted = false;
 	local_reset_book(ui->book, ui->rows * ui->cols);
 	ui_print_wrap(ui, text);
 }
@@ -269,7 +351,10 @@ static void local_print_info_bar(const ClientUI* ui)
 	for (int32_t i = 0; i < ui->cols; ++i)
 		display_add_char('=');
 	display_move(ui->rows, 3);
-	DISPLAY_PRINT_STR(" Page %d of %d (page up/down = navigate) ", ui->book->currentPageIndex, ui->book->pages);
+	if (ui->source != NULL)
+		DISPLAY_PRINT_STR(" Page %d of %d+ (page up/down = navigate) ", ui->book->currentPageIndex, ui->book->pages);
+	else
+		DISPLAY_PRINT_STR(" Page %d of %d (page up/down = navigate) ", ui->book->currentPageIndex, ui->book->pages);
 	display_move(fromY, fromX);
 }
 
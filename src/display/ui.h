@@ -3,11 +3,24 @@
 
 #include "text_input.h"
 
+/* Wrap text in these to have it drawn highlighted, a newline also ends it */
+#define UI_HIGHLIGHT_START	"\x01"
+#define UI_HIGHLIGHT_END	"\x02"
+
 typedef struct ClientUI ClientUI;
 
+/* Requests the next window of output, which may arrive later. The owner adds
+ * it with ui_append and then reports back with ui_page_source_done */
+typedef void (*UIPageSource)(void* state, ClientUI* ui);
+
 ClientUI* ui_new();
 void ui_free(ClientUI* ui);
 void ui_print_wrap(ClientUI* ui, const char* text);
+void ui_append(ClientUI* ui, const char* text);
+void ui_set_page_source(ClientUI* ui, UIPageSource source, void* state);
+bool ui_page_source_pending(const ClientUI* ui);
+void ui_page_source_done(ClientUI* ui, bool more);
+void ui_page_source_cancel(ClientUI* ui);
 void ui_print_command_prompt(ClientUI* ui,
 	struct TextInput* command, const char* prefix, const char* separator);
 void ui_page_next(ClientUI* ui);
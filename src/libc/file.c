@@ -0,0 +1,267 @@
+#if defined(_WIN32) || defined(_WIN64)
+#define _CRT_SECURE_NO_DEPRECATE
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#endif
+
+#include "file.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FILE_MAX_PATH	4096
+
+static bool local_walk(const char* path, FileWalkFn fn, void* state) {
+	char childPath[FILE_MAX_PATH];
+	bool keepWalking = true;
+#if defined(_WIN32) || defined(_WIN64)
+	WIN32_FIND_DATAA data;
+	snprintf(childPath, sizeof(childPath), "%s\\*", path);
+	HANDLE find = FindFirstFileA(childPath, &data);
+	if (find == INVALID_HANDLE_VALUE)
+		return true;
+	do {
+		if (strcmp(data.cFileName, ".") == 0 || strcmp(data.cFileName, "..") == 0)
+			continue;
+		snprintf(childPath, sizeof(childPath), "%s\\%s", path, data.cFileName);
+		if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			keepWalking = local_walk(childPath, fn, state);
+		else
+			keepWalking = fn(state, childPath);
+	} while (keepWalking && FindNextFileA(find, &data));
+	FindClose(find);
+#else
+	DIR* dir = opendir(path);
+	if (dir == NULL)
+		return true;
+	struct dirent* entry;
+	while (keepWalking && (entry = readdir(dir)) != NULL) {
+		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+			continue;
+		snprintf(childPath, sizeof(childPath), "%s/%s", path, entry->d_name);
+		struct stat st;
+		if (stat(childPath, &st) != 0)
+			continue;
+		if (S_ISDIR(st.st_mode))
+			keepWalking = local_walk(childPath, fn, state);
+		else if (S_ISREG(st.st_mode))
+			keepWalking = fn(state, childPath);
+	}
+	closedir(dir);
+#endif
+	return keepWalking;
+}
+
+bool file_walk_dir(const char* path, FileWalkFn fn, void* state) {
+#if defined(_WIN32) || defined(_WIN64)
+	DWORD attributes = GetFileAttributesA(path);
+	if (attributes == INVALID_FILE_ATTRIBUTES || !(attributes & FILE_ATTRIBUTE_DIRECTORY))
+		return false;
+#else
+	struct stat st;
+	if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode))
+		return false;
+#endif
+	return local_walk(path, fn, state);
+}
+
+bool file_view_open(const char* path, FileView* outView) {
+	outView->data = NULL;
+	outView->size = 0;
+	outView->handle = NULL;
+#if defined(_WIN32) || defined(_WIN64)
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) {
+		CloseHandle(file);
+		return false;
+	}
+	outView->size = (size_t)size.QuadPart;
+	if (outView->size > 0) {
+		HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping != NULL) {
+			outView->data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(mapping);
+		}
+	} else
+		outView->data = "";
+	CloseHandle(file);
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd == -1)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+		close(fd);
+		return false;
+	}
+	outView->size = (size_t)st.st_size;
+	if (outView->size > 0) {
+		void* map = mmap(NULL, outView->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map != MAP_FAILED) {
+			madvise(map, outView->size, MADV_SEQUENTIAL);
+			outView->data = map;
+		}
+	} else
+		outView->data = "";
+	close(fd);
+#endif
+	if (outView->data == NULL) {
+		outView->size = 0;
+		return false;
+	}
+	outView->handle = outView->size > 0 ? (void*)outView->data : NULL;
+	return true;
+}
+
+void file_view_close(FileView* view) {
+	if (view->handle != NULL) {
+#if defined(_WIN32) || defined(_WIN64)
+		UnmapViewOfFile(view->handle);
+#else
+		munmap(view->handle, view->size);
+#endif
+	}
+	view->data = NULL;
+	view->size = 0;
+	view->handle = NULL;
+}
+
+bool file_make_dir(const char* path) {
+#if defined(_WIN32) || defined(_WIN64)
+	if (CreateDirectoryA(path, NULL))
+		return true;
+	DWORD attributes = GetFileAttributesA(path);
+	return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+	if (mkdir(path, 0755) == 0)
+		return true;
+	struct stat st;
+	return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+#endif
+}
+
+bool file_write_parts(const char* path, const FilePart* parts, int count) {
+#if defined(_WIN32) || defined(_WIN64)
+	HANDLE file = CreateFileA(path, GENERIC_WRITE, 0, NULL,
+		CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	bool ok = true;
+	for (int i = 0; ok && i < count; ++i) {
+		const char* data = parts[i].data;
+		size_t left = parts[i].size;
+		while (ok && left > 0) {
+			DWORD chunk = left > 0x40000000 ? 0x40000000 : (DWORD)left;
+			DWORD written = 0;
+			ok = WriteFile(file, data, chunk, &written, NULL) && written > 0;
+			data += written;
+			left -= written;
+		}
+	}
+	CloseHandle(file);
+	return ok;
+#else
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return false;
+	struct iovec iov[FILE_MAX_PARTS];
+	if (count > FILE_MAX_PARTS)
+		count = FILE_MAX_PARTS;
+	for (int i = 0; i < count; ++i) {
+		iov[i].iov_base = (void*)parts[i].data;
+		iov[i].iov_len = parts[i].size;
+	}
+	// One system call in the common case, short writes resume where they stopped
+	struct iovec* next = iov;
+	bool ok = true;
+	while (ok && count > 0) {
+		ssize_t written = writev(fd, next, count);
+		if (written < 0) {
+			ok = false;
+			break;
+		}
+		while (count > 0 && (size_t)written >= next->iov_len) {
+			written -= (ssize_t)next->iov_len;
+			next++;
+			count--;
+		}
+		if (count > 0) {
+			next->iov_base = (char*)next->iov_base + written;
+			next->iov_len -= (size_t)written;
+		}
+	}
+	return close(fd) == 0 && ok;
+#endif
+}
+
+bool file_read_all(const char* path, char** buffer, size_t* capacity, size_t* outSize) {
+	*outSize = 0;
+#if defined(_WIN32) || defined(_WIN64)
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize)) {
+		CloseHandle(file);
+		return false;
+	}
+	size_t size = (size_t)fileSize.QuadPart;
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return false;
+	}
+	size_t size = (size_t)st.st_size;
+#endif
+	if (*capacity < size + 1) {
+		char* grown = realloc(*buffer, size + 1);
+		if (grown == NULL) {
+#if defined(_WIN32) || defined(_WIN64)
+			CloseHandle(file);
+#else
+			close(fd);
+#endif
+			return false;
+		}
+		*buffer = grown;
+		*capacity = size + 1;
+	}
+	size_t total = 0;
+	bool ok = true;
+	while (ok && total < size) {
+#if defined(_WIN32) || defined(_WIN64)
+		size_t left = size - total;
+		DWORD chunk = left > 0x40000000 ? 0x40000000 : (DWORD)left;
+		DWORD got = 0;
+		ok = ReadFile(file, *buffer + total, chunk, &got, NULL) && got > 0;
+#else
+		ssize_t got = pread(fd, *buffer + total, size - total, (off_t)total);
+		ok = got > 0;
+#endif
+		if (ok)
+			total += (size_t)got;
+	}
+#if defined(_WIN32) || defined(_WIN64)
+	CloseHandle(file);
+#else
+	close(fd);
+#endif
+	(*buffer)[total] = '\0';
+	*outSize = total;
+	return ok;
+}
@@ -0,0 +1,85 @@
+/**
+ * @file file.h
+ * @brief File system helpers
+ */
+
+#ifndef LIBC_FILE_H
+#define LIBC_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/******************************************************************************\
+* A read only view of a whole file mapped into memory, the data is not NUL
+* terminated so size must always be respected
+\******************************************************************************/
+typedef struct {
+	const char* data;
+	size_t size;
+	void* handle;
+} FileView;
+
+#define FILE_MAX_PARTS	8
+
+/* One piece of a file written with file_write_parts */
+typedef struct {
+	const void* data;
+	size_t size;
+} FilePart;
+
+/******************************************************************************\
+* Called for every regular file found while walking a directory
+* Returns:   False to stop walking
+* Parameter: state The state pointer given to file_walk_dir
+* Parameter: path The path of the file (only valid during the call)
+\******************************************************************************/
+typedef bool (*FileWalkFn)(void* state, const char* path);
+
+/******************************************************************************\
+* Recursively walk a directory tree calling the callback for each regular file
+* Returns:   False if the directory could not be opened or the walk was stopped
+* Parameter: path The root directory to walk
+* Parameter: fn The callback for each file
+* Parameter: state Passed through to the callback
+\******************************************************************************/
+bool file_walk_dir(const char* path, FileWalkFn fn, void* state);
+
+/******************************************************************************\
+* Map a file into memory without copying it
+* Returns:   False if the file could not be opened or mapped
+* Parameter: path The path of the file to map
+* Parameter: outView The view to fill in, release it with file_view_close
+\******************************************************************************/
+bool file_view_open(const char* path, FileView* outView);
+
+/******************************************************************************\
+* Unmap a view opened with file_view_open
+\******************************************************************************/
+void file_view_close(FileView* view);
+
+/******************************************************************************\
+* Create a directory, an existing directory also counts as success
+* Returns:   False if the directory does not exist afterwards
+\******************************************************************************/
+bool file_make_dir(const char* path);
+
+/******************************************************************************\
+* Create (or truncate) a file and write the parts to it back to back, with a
+* single vectored write where the platform has one
+* Returns:   False if the file could not be created or fully written
+* Parameter: count The number of parts, at most FILE_MAX_PARTS
+\******************************************************************************/
+bool file_write_parts(const char* path, const FilePart* parts, int count);
+
+/******************************************************************************\
+* Read a whole file into a reusable buffer, which is grown when it is too small
+* and NUL terminated after the data
+* Returns:   False if the file could not be opened or fully read
+* Parameter: buffer The buffer to read into (may start as NULL), free it after
+* Parameter: capacity The allocated size of the buffer, updated when it grows
+* Parameter: outSize The number of bytes read
+\******************************************************************************/
+bool file_read_all(const char* path, char** buffer, size_t* capacity, size_t* outSize);
+
+#endif
@@ -0,0 +1,80 @@
+#include "hash.h"
+
+#define HASH64_P1	11400714785074694791ULL
+#define HASH64_P2	14029467366897019727ULL
+#define HASH64_P3	1609587929392839161ULL
+#define HASH64_P4	9650029242287828579ULL
+#define HASH64_P5	2870177450012600261ULL
+
+static inline uint64_t local_rotl(uint64_t x, int r) {
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t local_read64(const uint8_t* p) {
+	return (uint64_t)p[0] | ((uint64_t)p[1] << 8) | ((uint64_t)p[2] << 16)
+		| ((uint64_t)p[3] << 24) | ((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40)
+		| ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+}
+
+static inline uint32_t local_read32(const uint8_t* p) {
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8)
+		| ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t local_round(uint64_t acc, uint64_t input) {
+	acc += input * HASH64_P2;
+	acc = local_rotl(acc, 31);
+	return acc * HASH64_P1;
+}
+
+static inline uint64_t local_merge_round(uint64_t acc, uint64_t val) {
+	acc ^= local_round(0, val);
+	return acc * HASH64_P1 + HASH64_P4;
+}
+
+uint64_t hash64(const void* data, size_t len, uint64_t seed) {
+	const uint8_t* p = data;
+	const uint8_t* end = p + len;
+	uint64_t h;
+	if (len >= 32) {
+		// Four independent lanes over 32 byte stripes
+		uint64_t v1 = seed + HASH64_P1 + HASH64_P2;
+		uint64_t v2 = seed + HASH64_P2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - HASH64_P1;
+		const uint8_t* limit = end - 32;
+		do {
+			v1 = local_round(v1, local_read64(p));
+			v2 = local_round(v2, local_read64(p + 8));
+			v3 = local_round(v3, local_read64(p + 16));
+			v4 = local_round(v4, local_read64(p + 24));
+			p += 32;
+		} while (p <= limit);
+		h = local_rotl(v1, 1) + local_rotl(v2, 7) + local_rotl(v3, 12) + local_rotl(v4, 18);
+		h = local_merge_round(h, v1);
+		h = local_merge_round(h, v2);
+		h = local_merge_round(h, v3);
+		h = local_merge_round(h, v4);
+	} else
+		h = seed + HASH64_P5;
+	h += (uint64_t)len;
+	for (; p + 8 <= end; p += 8) {
+		h ^= local_round(0, local_read64(p));
+		h = local_rotl(h, 27) * HASH64_P1 + HASH64_P4;
+	}
+	if (p + 4 <= end) {
+		h ^= (uint64_t)local_read32(p) * HASH64_P1;
+		h = local_rotl(h, 23) * HASH64_P2 + HASH64_P3;
+		p += 4;
+	}
+	for (; p < end; ++p) {
+		h ^= (uint64_t)*p * HASH64_P5;
+		h = local_rotl(h, 11) * HASH64_P1;
+	}
+	h ^= h >> 33;
+	h *= HASH64_P2;
+	h ^= h >> 29;
+	h *= HASH64_P3;
+	h ^= h >> 32;
+	return h;
+}
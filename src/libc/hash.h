@@ -0,0 +1,20 @@
+/**
+ * @file hash.h
+ * @brief Non-cryptographic hashing
+ */
+
+#ifndef LIBC_HASH_H
+#define LIBC_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/******************************************************************************\
+* 64 bit XXH64 hash of a buffer in a single pass. Input is read as little
+* endian so hashes stored on disk are the same on every platform
+* Returns:   The hash
+* Parameter: seed Chain a previous hash in here to hash several buffers
+\******************************************************************************/
+uint64_t hash64(const void* data, size_t len, uint64_t seed);
+
+#endif
@@ -0,0 +1,153 @@
+#include "lz.h"
+#include <string.h>
+
+#define LZ_MIN_MATCH		4
+#define LZ_HASH_BITS		13
+#define LZ_MAX_OFFSET		65535
+#define LZ_LAST_LITERALS	5	/* Matches stop this far from the end */
+#define LZ_INPUT_MARGIN		12	/* No match starts this close to the end */
+#define LZ_SKIP_TRIGGER		6	/* Search step grows every 64 misses */
+
+static inline uint32_t local_read32(const uint8_t* p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t local_hash(uint32_t seq) {
+	return (seq * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+static inline size_t local_length_bytes(size_t len) {
+	return len >= 15 ? (len - 15) / 255 + 1 : 0;
+}
+
+static inline uint8_t* local_write_length(uint8_t* op, size_t len) {
+	for (len -= 15; len >= 255; len -= 255)
+		*op++ = 255;
+	*op++ = (uint8_t)len;
+	return op;
+}
+
+/* Writes one sequence, a zero match length ends the block. NULL when full */
+static uint8_t* local_write_sequence(uint8_t* op, const uint8_t* opEnd,
+	const uint8_t* literals, size_t litLen, size_t offset, size_t matchLen)
+{
+	size_t need = 1 + local_length_bytes(litLen) + litLen;
+	if (matchLen > 0)
+		need += 2 + local_length_bytes(matchLen - LZ_MIN_MATCH);
+	if ((size_t)(opEnd - op) < need)
+		return NULL;
+	uint8_t* token = op++;
+	*token = (uint8_t)((litLen >= 15 ? 15 : litLen) << 4);
+	if (litLen >= 15)
+		op = local_write_length(op, litLen);
+	memcpy(op, literals, litLen);
+	op += litLen;
+	if (matchLen > 0) {
+		*op++ = (uint8_t)(offset & 0xFF);
+		*op++ = (uint8_t)(offset >> 8);
+		size_t code = matchLen - LZ_MIN_MATCH;
+		*token |= (uint8_t)(code >= 15 ? 15 : code);
+		if (code >= 15)
+			op = local_write_length(op, code);
+	}
+	return op;
+}
+
+size_t lz_compress_bound(size_t len) {
+	return len + len / 255 + 16;
+}
+
+size_t lz_compress(const void* src, size_t len, void* dst, size_t capacity) {
+	const uint8_t* in = src;
+	uint8_t* op = dst;
+	const uint8_t* opEnd = op + capacity;
+	size_t anchor = 0;
+	if (len > LZ_INPUT_MARGIN) {
+		// Positions are stored plus one so that zero means an empty slot
+		uint32_t table[1 << LZ_HASH_BITS] = { 0 };
+		size_t limit = len - LZ_INPUT_MARGIN;
+		size_t matchLimit = len - LZ_LAST_LITERALS;
+		size_t ip = 0;
+		size_t misses = 0;
+		while (ip < limit) {
+			uint32_t seq = local_read32(in + ip);
+			uint32_t h = local_hash(seq);
+			size_t ref = table[h];
+			table[h] = (uint32_t)(ip + 1);
+			if (ref == 0 || ip - (ref - 1) > LZ_MAX_OFFSET
+				|| local_read32(in + ref - 1) != seq)
+			{
+				// Incompressible runs are skipped over faster and faster
+				ip += 1 + (misses++ >> LZ_SKIP_TRIGGER);
+				continue;
+			}
+			ref--;
+			misses = 0;
+			size_t matchLen = LZ_MIN_MATCH;
+			while (ip + matchLen < matchLimit && in[ref + matchLen] == in[ip + matchLen])
+				matchLen++;
+			op = local_write_sequence(op, opEnd, in + anchor,
+				ip - anchor, ip - ref, matchLen);
+			if (op == NULL)
+				return 0;
+			ip += matchLen;
+			anchor = ip;
+		}
+	}
+	op = local_write_sequence(op, opEnd, in + anchor, len - anchor, 0, 0);
+	return op == NULL ? 0 : (size_t)(op - (uint8_t*)dst);
+}
+
+/* Reads a length extension, false if it runs off the end of the input */
+static inline bool local_read_length(const uint8_t** ip, const uint8_t* ipEnd, size_t* len) {
+	uint8_t b;
+	do {
+		if (*ip >= ipEnd)
+			return false;
+		b = *(*ip)++;
+		*len += b;
+	} while (b == 255);
+	return true;
+}
+
+bool lz_decompress(const void* src, size_t len, void* dst, size_t outLen) {
+	const uint8_t* ip = src;
+	const uint8_t* ipEnd = ip + len;
+	uint8_t* out = dst;
+	size_t op = 0;
+	while (ip < ipEnd) {
+		uint8_t token = *ip++;
+		size_t litLen = token >> 4;
+		if (litLen == 15 && !local_read_length(&ip, ipEnd, &litLen))
+			return false;
+		if ((size_t)(ipEnd - ip) < litLen || outLen - op < litLen)
+			return false;
+		memcpy(out + op, ip, litLen);
+		ip += litLen;
+		op += litLen;
+		if (ip == ipEnd)
+			break;
+		if (ipEnd - ip < 2)
+			return false;
+		size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+		ip += 2;
+		size_t matchLen = token & 15;
+		if (matchLen == 15 && !local_read_length(&ip, ipEnd, &matchLen))
+			return false;
+		matchLen += LZ_MIN_MATCH;
+		if (offset == 0 || offset > op || outLen - op < matchLen)
+			return false;
+		// Overlapping copies repeat the tail, so they go a byte at a time
+		const uint8_t* ref = out + op - offset;
+		if (offset >= matchLen)
+			memcpy(out + op, ref, matchLen);
+		else {
+			for (size_t i = 0; i < matchLen; ++i)
+				out[op + i] = ref[i];
+		}
+		op += matchLen;
+	}
+	return op == outLen;
+}
@@ -0,0 +1,38 @@
+/**
+ * @file lz.h
+ * @brief LZ block compression
+ */
+
+#ifndef LIBC_LZ_H
+#define LIBC_LZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/******************************************************************************\
+* A small LZ77 block codec in the LZ4 block format: each sequence is a token
+* (literal and match length nibbles), the literals, a 2 byte little endian
+* offset and any length extension bytes. Blocks carry no header so the caller
+* has to keep the decompressed size
+\******************************************************************************/
+
+/******************************************************************************\
+* Returns:   The largest compressed size possible for an input of len bytes
+\******************************************************************************/
+size_t lz_compress_bound(size_t len);
+
+/******************************************************************************\
+* Compress src into dst without writing past capacity
+* Returns:   The compressed size, or 0 if it would not fit in capacity
+\******************************************************************************/
+size_t lz_compress(const void* src, size_t len, void* dst, size_t capacity);
+
+/******************************************************************************\
+* Decompress a block that must expand to exactly outLen bytes, malformed or
+* truncated input is rejected rather than read or written out of bounds
+* Returns:   False if the block is corrupt
+\******************************************************************************/
+bool lz_decompress(const void* src, size_t len, void* dst, size_t outLen);
+
+#endif
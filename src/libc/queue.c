@@ -0,0 +1,86 @@
+#include "queue.h"
+#include <stdlib.h>
+#include <threads.h>
+#include <time.h>
+
+struct Queue {
+	mtx_t lock;
+	cnd_t notFull;
+	cnd_t notEmpty;
+	size_t capacity;
+	size_t head;
+	size_t count;
+	bool closed;
+	void* items[];
+};
+
+Queue* queue_new(size_t capacity) {
+	Queue* queue = calloc(1, sizeof(Queue) + capacity * sizeof(void*));
+	if (queue == NULL)
+		return NULL;
+	queue->capacity = capacity;
+	mtx_init(&queue->lock, mtx_plain);
+	cnd_init(&queue->notFull);
+	cnd_init(&queue->notEmpty);
+	return queue;
+}
+
+void queue_free(Queue* queue) {
+	cnd_destroy(&queue->notEmpty);
+	cnd_destroy(&queue->notFull);
+	mtx_destroy(&queue->lock);
+	free(queue);
+}
+
+bool queue_push(Queue* queue, void* item) {
+	mtx_lock(&queue->lock);
+	while (!queue->closed && queue->count == queue->capacity)
+		cnd_wait(&queue->notFull, &queue->lock);
+	bool pushed = !queue->closed;
+	if (pushed) {
+		queue->items[(queue->head + queue->count) % queue->capacity] = item;
+		queue->count++;
+		cnd_signal(&queue->notEmpty);
+	}
+	mtx_unlock(&queue->lock);
+	return pushed;
+}
+
+QueueResult queue_pop(Queue* queue, void** outItem, int32_t timeoutMs) {
+	struct timespec until;
+	if (timeoutMs != QUEUE_WAIT_FOREVER) {
+		timespec_get(&until, TIME_UTC);
+		until.tv_sec += timeoutMs / 1000;
+		until.tv_nsec += (long)(timeoutMs % 1000) * 1000000L;
+		if (until.tv_nsec >= 1000000000L) {
+			until.tv_sec++;
+			until.tv_nsec -= 1000000000L;
+		}
+	}
+	QueueResult res = QUEUE_ITEM;
+	mtx_lock(&queue->lock);
+	while (queue->count == 0 && !queue->closed && res == QUEUE_ITEM) {
+		if (timeoutMs == QUEUE_WAIT_FOREVER)
+			cnd_wait(&queue->notEmpty, &queue->lock);
+		else if (cnd_timedwait(&queue->notEmpty, &queue->lock, &until) == thrd_timedout)
+			res = QUEUE_TIMEOUT;
+	}
+	if (queue->count > 0) {
+		*outItem = queue->items[queue->head];
+		queue->head = (queue->head + 1) % queue->capacity;
+		queue->count--;
+		cnd_signal(&queue->notFull);
+		res = QUEUE_ITEM;
+	} else if (queue->closed)
+		res = QUEUE_CLOSED;
+	mtx_unlock(&queue->lock);
+	return res;
+}
+
+void queue_close(Queue* queue) {
+	mtx_lock(&queue->lock);
+	queue->closed = true;
+	cnd_broadcast(&queue->notFull);
+	cnd_broadcast(&queue->notEmpty);
+	mtx_unlock(&queue->lock);
+}
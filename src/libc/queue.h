@@ -0,0 +1,61 @@
+/**
+ * @file queue.h
+ * @brief Bounded blocking queue for handing work between threads
+ */
+
+#ifndef LIBC_QUEUE_H
+#define LIBC_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define QUEUE_WAIT_FOREVER	-1
+
+typedef enum {
+	QUEUE_ITEM,
+	QUEUE_TIMEOUT,
+	QUEUE_CLOSED,
+} QueueResult;
+
+/******************************************************************************\
+* A fixed capacity first in first out queue of pointers that any number of
+* threads can push to and pop from. Pushing waits while the queue is full and
+* popping waits while it is empty, which keeps producers from running ahead
+\******************************************************************************/
+typedef struct Queue Queue;
+
+/******************************************************************************\
+* Returns:   The new queue or NULL if it could not be created
+* Parameter: capacity The most items the queue holds before pushes wait
+\******************************************************************************/
+Queue* queue_new(size_t capacity);
+
+/******************************************************************************\
+* Free the queue, no thread may be waiting on it. Items still in the queue are
+* not freed
+\******************************************************************************/
+void queue_free(Queue* queue);
+
+/******************************************************************************\
+* Add an item, waiting for room while the queue is full
+* Returns:   False if the queue was closed, the item was not added
+\******************************************************************************/
+bool queue_push(Queue* queue, void* item);
+
+/******************************************************************************\
+* Take the oldest item, waiting while the queue is empty. Items pushed before
+* the queue was closed are still handed out after it is closed
+* Returns:   QUEUE_ITEM when outItem was set, QUEUE_TIMEOUT if nothing arrived
+*            in time, or QUEUE_CLOSED once the queue is closed and empty
+* Parameter: timeoutMs How long to wait, QUEUE_WAIT_FOREVER to never time out
+\******************************************************************************/
+QueueResult queue_pop(Queue* queue, void** outItem, int32_t timeoutMs);
+
+/******************************************************************************\
+* Close the queue, waiting pushes fail and pops drain what is left. Closing an
+* already closed queue does nothing
+\******************************************************************************/
+void queue_close(Queue* queue);
+
+#endif
@@ -150,6 +150,58 @@ bool utf8valid_s(const char* const str, size_t maxLen) {
 	return true;
 }
 
+bool utf8stream_feed(Utf8Stream* stream, const char* data, size_t len) {
+	const unsigned char* c = (const unsigned char*)data;
+	size_t i = 0;
+	while (i < len) {
+		if (stream->need == 0) {
+			// Most text is ASCII, skip it a word at a time
+			while (i + sizeof(uint64_t) <= len) {
+				uint64_t word;
+				memcpy(&word, c + i, sizeof(word));
+				if (word & 0x8080808080808080ULL)
+					break;
+				i += sizeof(word);
+			}
+			if (i == len)
+				break;
+			unsigned char b = c[i++];
+			if (b < 0x80)
+				continue;
+			stream->lo = 0x80;
+			stream->hi = 0xBF;
+			if (b >= 0xC2 && b <= 0xDF)
+				stream->need = 1;
+			else if (b >= 0xE0 && b <= 0xEF) {
+				stream->need = 2;
+				if (b == 0xE0)
+					stream->lo = 0xA0;
+				else if (b == 0xED)
+					stream->hi = 0x9F;
+			} else if (b >= 0xF0 && b <= 0xF4) {
+				stream->need = 3;
+				if (b == 0xF0)
+					stream->lo = 0x90;
+				else if (b == 0xF4)
+					stream->hi = 0x8F;
+			} else
+				return false;
+		} else {
+			unsigned char b = c[i++];
+			if (b < stream->lo || b > stream->hi)
+				return false;
+			stream->need--;
+			stream->lo = 0x80;
+			stream->hi = 0xBF;
+		}
+	}
+	return true;
+}
+
+bool utf8stream_end(const Utf8Stream* stream) {
+	return stream->need == 0;
+}
+
 /******************************************************************************/
 /******************************************************************************/
 /* String modifications                                                       */
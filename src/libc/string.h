@@ -88,6 +88,33 @@ bool utf8valid(const char* const str);
 */
 bool utf8valid_s(const char* const str, size_t maxLen);
 
+/**
+ * Validation state carried between the pieces of a UTF-8 stream, zero it to
+ * start a new stream
+*/
+typedef struct {
+	uint8_t need;
+	uint8_t lo;
+	uint8_t hi;
+} Utf8Stream;
+
+/**
+ * Validate the next piece of a UTF-8 stream, a sequence may be split across
+ * pieces. Overlong forms, surrogates and code points past U+10FFFF are invalid
+ * @param[in,out] stream The stream state
+ * @param[in] data The next bytes of the stream
+ * @param[in] len The number of bytes in data
+ * @return False if the stream is invalid
+*/
+bool utf8stream_feed(Utf8Stream* stream, const char* data, size_t len);
+
+/**
+ * Determine if a validated stream ended on a whole character
+ * @param[in] stream The stream state
+ * @return False if the stream ended in the middle of a sequence
+*/
+bool utf8stream_end(const Utf8Stream* stream);
+
 /******************************************************************************\
 * Modifies the supplied string to trim the beginning and by removing any
 * occurrence of \n, \t, \r, or spaces using the pre-existing memory space
@@ -1,14 +1,18 @@
-﻿#include <signal.h>
+﻿#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
 #include <string.h>
 #include <stdbool.h>
 #include <display/ui.h>
 #include <notes/notes.h>
+#include <libc/file.h>
 #include <libc/string.h>
 #include <display/input.h>
 #include <display/display.h>
 #include <display/text_input.h>
 
 #define INPUT_BUFFER_SIZE	65556
+#define CONFIG_FILE			"./nc.conf"
 static volatile bool s_quit = 0;
 
 #define SPLASH	\
@@ -23,7 +27,18 @@ static volatile bool s_quit = 0;
 "new - Create a new note\n"				\
 "list - List all notes\n"				\
 "delete [id] - Delete a note\n"			\
+"delete [1-9,12] - Delete a list or range of notes\n"	\
+"delete [query] - Delete every note matching a search\n"	\
 "find [query] - Search all notes\n"		\
+"find - Search as you type\n"			\
+"grep [text] - Find notes containing the text anywhere, even inside words\n"	\
+"grep-index [on|off] - Build or drop the index grep uses\n"	\
+"import-dir [path] - Import a directory of text files\n"	\
+"import-archive [file] - Import a .jsonl file or a %% separated bundle\n"	\
+"compact - Merge the search index into one segment\n"	\
+"dedupe - Remove notes with the same title and text\n"	\
+"export [file.jsonl|dir] [query] - Export all notes or a search\n"	\
+"stats - Show the size of the notebook and its search index\n"	\
 "[id] - View a note matching this id\n"	\
 "clear - Clear the screen"
 
@@ -31,6 +46,83 @@ static inline void local_interrupt_handler(int sig) {
 	s_quit = true;
 }
 
+typedef struct {
+	char profile[32];
+	int32_t importBatchSize;
+	int32_t importThreads;
+	double titleWeight;
+	double bodyWeight;
+	bool snapshot;
+} Settings;
+
+static inline void local_apply_setting(Settings* settings, const char* key, const char* value) {
+	if (streqi(key, "profile"))
+		snprintf(settings->profile, sizeof(settings->profile), "%s", value);
+	else if (streqi(key, "batch")) {
+		int32_t batch = strtoint32(value);
+		if (batch > 0)
+			settings->importBatchSize = batch;
+	} else if (streqi(key, "threads")) {
+		int32_t threads = strtoint32(value);
+		if (threads > 0 && threads <= NOTES_IMPORT_MAX_THREADS)
+			settings->importThreads = threads;
+	} else if (streqi(key, "weights")) {
+		// "title, body", how much a match in each column counts when ranking
+		char* end;
+		double title = strtod(value, &end);
+		while (*end == ',' || *end == ' ')
+			end++;
+		double body = strtod(end, NULL);
+		if (title >= 0.0 && body >= 0.0 && title + body > 0.0) {
+			settings->titleWeight = title;
+			settings->bodyWeight = body;
+		}
+	} else if (streqi(key, "snapshot"))
+		settings->snapshot = streqi(value, "true") || streqi(value, "yes") || strcmp(value, "1") == 0;
+}
+
+/* The config file holds one "key = value" per line, # starts a comment */
+static inline void local_load_config(Settings* settings, const char* path) {
+	FileView view;
+	if (!file_view_open(path, &view))
+		return;
+	size_t offset = 0;
+	while (offset < view.size) {
+		const char* start = view.data + offset;
+		const char* end = memchr(start, '\n', view.size - offset);
+		size_t len = end != NULL ? (size_t)(end - start) : view.size - offset;
+		offset += len + 1;
+		char line[256];
+		snprintf(line, sizeof(line), "%.*s", (int)len, start);
+		char* comment = strchr(line, '#');
+		if (comment != NULL)
+			*comment = '\0';
+		char* value = strchr(line, '=');
+		if (value == NULL)
+			continue;
+		*value++ = '\0';
+		trim(line);
+		trim(value);
+		local_apply_setting(settings, line, value);
+	}
+	file_view_close(&view);
+}
+
+static inline void local_apply_args(Settings* settings, int argc, char** argv) {
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc)
+			local_apply_setting(settings, "batch", argv[++i]);
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			local_apply_setting(settings, "threads", argv[++i]);
+		else if (strcmp(argv[i], "--weights") == 0 && i + 1 < argc)
+			local_apply_setting(settings, "weights", argv[++i]);
+		else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc)
+			local_apply_setting(settings, "profile", argv[++i]);
+		else if (strcmp(argv[i], "--snapshot") == 0)
+			local_apply_setting(settings, "snapshot", "true");
+	}
+}
+
 int main(int argc, char** argv) {
 	signal(SIGINT, local_interrupt_handler);
 	s_quit = false;
@@ -39,12 +131,43 @@ int main(int argc, char** argv) {
 	InputState state;
 	state.command = text_input_new(INPUT_BUFFER_SIZE);
 	state.ui = ui_new();
+	state.key = ERR;
 	ui_input_area_adjusted(state.ui, 1);
 	ui_clear_and_print(state.ui, SPLASH "\n");
+	// Command line arguments take priority over the config file
+	Settings settings = {
+		.profile = DB_PROFILE_INTERACTIVE,
+		.importBatchSize = NOTES_IMPORT_BATCH_SIZE,
+		.importThreads = NOTES_IMPORT_THREADS,
+		.titleWeight = NOTES_TITLE_WEIGHT,
+		.bodyWeight = NOTES_BODY_WEIGHT
+	};
+	local_load_config(&settings, CONFIG_FILE);
+	local_apply_args(&settings, argc, argv);
+	const DbProfile* profile = db_profile_find(settings.profile);
+	if (profile == NULL) {
+		ui_print_wrap(state.ui, "\nUnknown storage profile, using " DB_PROFILE_INTERACTIVE "\n");
+		profile = db_profile_find(DB_PROFILE_INTERACTIVE);
+	}
 	ui_print_command_prompt(state.ui, state.command, ">\0", " \0");
-	Notes* notes = notes_new(&s_quit);
+	Notes* notes = notes_new(&s_quit, profile);
+	if (notes == NULL) {
+		ui_free(state.ui);
+		text_input_free(state.command);
+		display_quit();
+		fprintf(stderr, "Could not open %s, it is damaged or from a newer version\n", NOTES_DB_PATH);
+		return 1;
+	}
+	notes->importBatchSize = settings.importBatchSize;
+	notes->importThreads = settings.importThreads;
+	notes->titleWeight = settings.titleWeight;
+	notes->bodyWeight = settings.bodyWeight;
+	if (settings.snapshot)
+		notes_snapshot(notes, &state);
 	while (!s_quit) {
-		if (text_input_read(&state, DKEY_RETURN) && text_input_get_len(state.command) > 0) {
+		bool entered = text_input_read(&state, DKEY_RETURN);
+		notes_poll(notes, &state);
+		if (entered && text_input_get_len(state.command) > 0) {
 			if (strcmp(text_input_get_buffer(state.command), "exit") == 0) {
 				s_quit = true;
 			} else if (strcmp(text_input_get_buffer(state.command), "clear") == 0) {
@@ -55,6 +178,12 @@ int main(int argc, char** argv) {
 			{
 				ui_clear_and_print(state.ui, "");
 				notes_list(notes, &state);
+			} else if (strcmp(text_input_get_buffer(state.command), "compact") == 0) {
+				notes_compact(notes, &state);
+			} else if (strcmp(text_input_get_buffer(state.command), "dedupe") == 0) {
+				notes_dedupe(notes, &state);
+			} else if (strcmp(text_input_get_buffer(state.command), "stats") == 0) {
+				notes_stats(notes, &state);
 			} else if (strcmp(text_input_get_buffer(state.command), "create") == 0
 				|| strcmp(text_input_get_buffer(state.command), "new") == 0)
 			{
@@ -62,26 +191,28 @@ int main(int argc, char** argv) {
 			} else if (strcmp(text_input_get_buffer(state.command), "search") == 0
 				|| strcmp(text_input_get_buffer(state.command), "find") == 0)
 			{
-				ui_clear_and_print(state.ui, "Enter your search term...");
-				text_input_clear(state.command);
-				ui_print_command_prompt(state.ui, state.command, ">\0", " \0");
-				while (true) {
-					if (text_input_read(&state, DKEY_RETURN) && text_input_get_len(state.command) > 0) {
-						notes_search(notes, &state, text_input_get_buffer(state.command));
-						break;
-					}
-					display_refresh();
-				}
+				notes_search_live(notes, &state);
 			} else if (stridxof(text_input_get_buffer(state.command), "find ", 0) == 0)
 				notes_search(notes, &state, text_input_get_buffer(state.command) + 5);
 			else if (stridxof(text_input_get_buffer(state.command), "search ", 0) == 0)
 				notes_search(notes, &state, text_input_get_buffer(state.command) + 7);
+			else if (strcmp(text_input_get_buffer(state.command), "grep-index on") == 0)
+				notes_grep_index(notes, &state, true);
+			else if (strcmp(text_input_get_buffer(state.command), "grep-index off") == 0)
+				notes_grep_index(notes, &state, false);
+			else if (stridxof(text_input_get_buffer(state.command), "grep ", 0) == 0)
+				notes_grep(notes, &state, text_input_get_buffer(state.command) + 5);
+			else if (stridxof(text_input_get_buffer(state.command), "import-archive ", 0) == 0)
+				notes_import_archive(notes, &state, text_input_get_buffer(state.command) + 15);
+			else if (stridxof(text_input_get_buffer(state.command), "import-dir ", 0) == 0)
+				notes_import_dir(notes, &state, text_input_get_buffer(state.command) + 11);
 			else if (stridxof(text_input_get_buffer(state.command), "import ", 0) == 0)
 				notes_import(notes, &state, text_input_get_buffer(state.command) + 7);
-			else if (stridxof(text_input_get_buffer(state.command), "delete ", 0) == 0) {
-				int id = strtoint32(text_input_get_buffer(state.command) + 7);
-				notes_delete(notes, &state, id);
-			} else {
+			else if (stridxof(text_input_get_buffer(state.command), "export ", 0) == 0)
+				notes_export(notes, &state, text_input_get_buffer(state.command) + 7);
+			else if (stridxof(text_input_get_buffer(state.command), "delete ", 0) == 0)
+				notes_delete(notes, &state, text_input_get_buffer(state.command) + 7);
+			else {
 				int id = strtoint32(text_input_get_buffer(state.command));
 				notes_select(notes, &state, id);
 			}
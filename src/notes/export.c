@@ -0,0 +1,304 @@
+#include "notes.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <threads.h>
+#include <stdatomic.h>
+#include <db/query.h>
+#include <db/functions.h>
+#include <display/ui.h>
+#include <display/display.h>
+#include <libc/file.h>
+#include <libc/string.h>
+#include <notes/search.h>
+
+#define EXPORT_THREADS		4
+#define EXPORT_CHUNKS		16						/* Rowid ranges per thread */
+#define EXPORT_FLUSH_SIZE	(4 * 1024 * 1024)		/* Per thread JSONL buffer */
+#define EXPORT_PROGRESS_OPS	10000
+#define EXPORT_STATUS_MS	100
+#define EXPORT_PATH_SIZE	4096
+#define BOUNDS_FORMAT		"SELECT min(`id`), max(`id`) FROM `NoteData`"
+#define EXPORT_ALL_FORMAT	"SELECT `id`, `created`, `updated`, `title`, nc_body(`body`, `size`) " \
+	"FROM `NoteData` WHERE `id` >= ?1 AND `id` < ?2 ORDER BY `id`"
+#define EXPORT_MATCH_FORMAT	"SELECT d.`id`, d.`created`, d.`updated`, d.`title`, nc_body(d.`body`, d.`size`) " \
+	"FROM `Notes` AS n JOIN `NoteData` AS d ON d.`id`=n.`rowid` " \
+	"WHERE `Notes` MATCH ?3 AND n.`rowid` >= ?1 AND n.`rowid` < ?2"
+
+/* Shared by the export threads, each one claims the next rowid range */
+typedef struct {
+	const char* path;
+	const char* expr;
+	const DbProfile* profile;
+	const DbSnapshot* snapshot;
+	bool jsonl;
+	FILE* out;
+	mtx_t outLock;
+	int64_t first;
+	int64_t span;
+	int32_t chunks;
+	atomic_int nextChunk;
+	atomic_int running;
+	atomic_llong notes;
+	atomic_llong bytes;
+	atomic_bool cancel;
+	atomic_bool failed;
+} NotesExport;
+
+typedef struct {
+	char* data;
+	size_t len;
+	size_t capacity;
+} ExportBuffer;
+
+static inline double local_now() {
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0;
+}
+
+static void local_reserve(ExportBuffer* buff, size_t extra) {
+	if (buff->capacity - buff->len >= extra)
+		return;
+	size_t capacity = buff->capacity > 0 ? buff->capacity : 4096;
+	while (capacity - buff->len < extra)
+		capacity *= 2;
+	buff->data = realloc(buff->data, capacity);
+	buff->capacity = capacity;
+}
+
+static void local_append(ExportBuffer* buff, const char* text, size_t len) {
+	local_reserve(buff, len);
+	memcpy(buff->data + buff->len, text, len);
+	buff->len += len;
+}
+
+/* Appends the text as a quoted JSON string, runs of plain bytes are copied whole */
+static void local_append_json(ExportBuffer* buff, const char* text, size_t len) {
+	local_append(buff, "\"", 1);
+	size_t run = 0;
+	for (size_t i = 0; i < len; ++i) {
+		unsigned char c = (unsigned char)text[i];
+		if (c >= 0x20 && c != '"' && c != '\\')
+			continue;
+		local_append(buff, text + run, i - run);
+		run = i + 1;
+		char escape[8];
+		switch (c) {
+			case '"':	local_append(buff, "\\\"", 2); break;
+			case '\\':	local_append(buff, "\\\\", 2); break;
+			case '\n':	local_append(buff, "\\n", 2); break;
+			case '\r':	local_append(buff, "\\r", 2); break;
+			case '\t':	local_append(buff, "\\t", 2); break;
+			default:
+				snprintf(escape, sizeof(escape), "\\u%04x", c);
+				local_append(buff, escape, 6);
+				break;
+		}
+	}
+	local_append(buff, text + run, len - run);
+	local_append(buff, "\"", 1);
+}
+
+static bool local_flush(NotesExport* exp, ExportBuffer* buff) {
+	if (buff->len == 0)
+		return true;
+	mtx_lock(&exp->outLock);
+	bool ok = fwrite(buff->data, 1, buff->len, exp->out) == buff->len;
+	mtx_unlock(&exp->outLock);
+	buff->len = 0;
+	return ok;
+}
+
+static bool local_export_row(NotesExport* exp, ExportBuffer* buff, sqlite3_stmt* pStmt) {
+	int64_t id = sqlite3_column_int64(pStmt, 0);
+	const char* title = (const char*)sqlite3_column_text(pStmt, 3);
+	size_t titleLen = (size_t)sqlite3_column_bytes(pStmt, 3);
+	const char* body = (const char*)sqlite3_column_text(pStmt, 4);
+	size_t bodyLen = (size_t)sqlite3_column_bytes(pStmt, 4);
+	if (title == NULL || body == NULL)
+		return false;
+	atomic_fetch_add(&exp->notes, 1);
+	atomic_fetch_add(&exp->bytes, (long long)(titleLen + bodyLen));
+	if (exp->jsonl) {
+		char head[128];
+		int headLen = snprintf(head, sizeof(head), "{\"id\":%lld,\"created\":%lld,\"updated\":%lld,\"title\":",
+			(long long)id, (long long)sqlite3_column_int64(pStmt, 1),
+			(long long)sqlite3_column_int64(pStmt, 2));
+		local_append(buff, head, (size_t)headLen);
+		local_append_json(buff, title, titleLen);
+		local_append(buff, ",\"body\":", 8);
+		local_append_json(buff, body, bodyLen);
+		local_append(buff, "}\n", 2);
+		return buff->len < EXPORT_FLUSH_SIZE || local_flush(exp, buff);
+	}
+	// The same layout import expects, the title line and then the body
+	char path[EXPORT_PATH_SIZE];
+	snprintf(path, sizeof(path), "%s/%lld.txt", exp->path, (long long)id);
+	FilePart parts[] = {
+		{ title, titleLen },
+		{ "\n", 1 },
+		{ body, bodyLen }
+	};
+	return file_write_parts(path, parts, 3);
+}
+
+static int local_export_cancelled(void* state) {
+	return atomic_load(&((NotesExport*)state)->cancel);
+}
+
+static int local_export_thread(void* state) {
+	NotesExport* exp = state;
+	sqlite3* db = NULL;
+	bool opened = exp->snapshot != NULL ? db_snapshot_open(exp->snapshot, &db)
+		: sqlite3_open_v2(NOTES_DB_PATH, &db, SQLITE_OPEN_READONLY, NULL) == SQLITE_OK;
+	if (!opened) {
+		atomic_store(&exp->failed, true);
+		sqlite3_close(db);
+		atomic_fetch_sub(&exp->running, 1);
+		return 0;
+	}
+	sqlite3_busy_timeout(db, DB_BUSY_TIMEOUT);
+	db_functions_register(db);
+	if (exp->snapshot == NULL)
+		db_profile_apply(db, exp->profile, false);
+	sqlite3_progress_handler(db, EXPORT_PROGRESS_OPS, local_export_cancelled, exp);
+	QueryCache* queries = query_cache_new(db);
+	ExportBuffer buff = { 0 };
+	int chunk;
+	while (!atomic_load(&exp->cancel) && !atomic_load(&exp->failed)
+		&& (chunk = atomic_fetch_add(&exp->nextChunk, 1)) < exp->chunks)
+	{
+		sqlite3_stmt* pStmt = query_cache_get(queries,
+			exp->expr != NULL ? EXPORT_MATCH_FORMAT : EXPORT_ALL_FORMAT);
+		if (pStmt == NULL) {
+			atomic_store(&exp->failed, true);
+			break;
+		}
+		int64_t from = exp->first + (int64_t)chunk * exp->span;
+		query_bind_int64(pStmt, 1, from);
+		query_bind_int64(pStmt, 2, from + exp->span);
+		if (exp->expr != NULL)
+			query_bind_text(pStmt, 3, exp->expr, -1);
+		int res;
+		while ((res = query_step(pStmt)) == QUERY_ROW) {
+			if (!local_export_row(exp, &buff, pStmt)) {
+				atomic_store(&exp->failed, true);
+				break;
+			}
+		}
+		if (res == QUERY_ERR && !atomic_load(&exp->cancel))
+			atomic_store(&exp->failed, true);
+		query_done(pStmt);
+	}
+	if (exp->jsonl && !local_flush(exp, &buff))
+		atomic_store(&exp->failed, true);
+	free(buff.data);
+	query_cache_free(queries);
+	sqlite3_close(db);
+	atomic_fetch_sub(&exp->running, 1);
+	return 0;
+}
+
+static void local_print_export_progress(NotesExport* exp, InputState* state,
+	const char* status, double start)
+{
+	char output[512];
+	double elapsed = local_now() - start;
+	if (elapsed <= 0.0)
+		elapsed = 0.000001;
+	double mb = (double)atomic_load(&exp->bytes) / (1024.0 * 1024.0);
+	snprintf(output, sizeof(output),
+		"%s\nExported %lld notes (%.2f MB) to %.200s\n%.1f notes/sec, %.2f MB/sec",
+		status, (long long)atomic_load(&exp->notes), mb, exp->path,
+		(double)atomic_load(&exp->notes) / elapsed, mb / elapsed);
+	ui_clear_and_print(state->ui, output);
+}
+
+void notes_export(Notes* notes, InputState* state, const char* args) {
+	// The first word is where to export to, anything after it is a search
+	char path[EXPORT_PATH_SIZE];
+	while (*args == ' ')
+		args++;
+	size_t pathLen = strcspn(args, " ");
+	if (pathLen == 0 || pathLen >= sizeof(path)) {
+		ui_clear_and_print(state->ui, "Give a .jsonl file or a directory to export to");
+		return;
+	}
+	memcpy(path, args, pathLen);
+	path[pathLen] = '\0';
+	char* expr = NULL;
+	const char* query = args + pathLen;
+	while (*query == ' ')
+		query++;
+	if (*query != '\0' && !search_compile(query, &expr)) {
+		ui_clear_and_print(state->ui, "Could not locate any notes to export");
+		return;
+	}
+	NotesExport exp = {
+		.path = path,
+		.expr = expr,
+		.profile = notes->profile,
+		.snapshot = notes->snapshot,
+		.jsonl = strcmpend(path, ".jsonl") == 0
+	};
+	sqlite3_stmt* pStmt = query_cache_get(notes->queries, BOUNDS_FORMAT);
+	bool empty = pStmt == NULL || query_step(pStmt) != QUERY_ROW
+		|| sqlite3_column_type(pStmt, 0) == SQLITE_NULL;
+	if (!empty) {
+		exp.first = sqlite3_column_int64(pStmt, 0);
+		// Ranges are even in id space, ids are dense enough for that to balance
+		exp.chunks = EXPORT_THREADS * EXPORT_CHUNKS;
+		exp.span = (sqlite3_column_int64(pStmt, 1) - exp.first) / exp.chunks + 1;
+	}
+	if (pStmt != NULL)
+		query_done(pStmt);
+	if (empty) {
+		ui_clear_and_print(state->ui, "There are no notes to export");
+		free(expr);
+		return;
+	}
+	if (exp.jsonl) {
+		exp.out = fopen(path, "wb");
+		if (exp.out != NULL)
+			setvbuf(exp.out, NULL, _IONBF, 0);
+	}
+	if (exp.jsonl ? exp.out == NULL : !file_make_dir(path)) {
+		ui_clear_and_print(state->ui, "Failed to open the export destination");
+		free(expr);
+		return;
+	}
+	mtx_init(&exp.outLock, mtx_plain);
+	double start = local_now();
+	thrd_t threads[EXPORT_THREADS];
+	int started = 0;
+	for (; started < EXPORT_THREADS; ++started) {
+		atomic_fetch_add(&exp.running, 1);
+		if (thrd_create(&threads[started], local_export_thread, &exp) != thrd_success) {
+			atomic_fetch_sub(&exp.running, 1);
+			break;
+		}
+	}
+	if (started == 0)
+		atomic_store(&exp.failed, true);
+	while (atomic_load(&exp.running) > 0) {
+		if (*notes->prgSig)
+			atomic_store(&exp.cancel, true);
+		local_print_export_progress(&exp, state, "Exporting...", start);
+		display_refresh();
+		thrd_sleep(&(struct timespec){ .tv_nsec = EXPORT_STATUS_MS * 1000000L }, NULL);
+	}
+	for (int i = 0; i < started; ++i)
+		thrd_join(threads[i], NULL);
+	mtx_destroy(&exp.outLock);
+	if (exp.out != NULL && fclose(exp.out) != 0)
+		atomic_store(&exp.failed, true);
+	if (atomic_load(&exp.cancel))
+		local_print_export_progress(&exp, state, "Export cancelled, the output is incomplete", start);
+	else if (atomic_load(&exp.failed))
+		local_print_export_progress(&exp, state, "Export failed, the output is incomplete", start);
+	else
+		local_print_export_progress(&exp, state, "Export complete!", start);
+	free(expr);
+}
@@ -3,221 +3,1278 @@
 //
 
 #include "notes.h"
+#include <ctype.h>
 #include <stdio.h>
+#include <float.h>
 #include <assert.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
+#include <threads.h>
+#include <stdatomic.h>
 #include <db/query.h>
+#include <db/functions.h>
+#include <db/worker.h>
 #include <display/ui.h>
+#include <libc/file.h>
+#include <libc/queue.h>
 #include <libc/string.h>
+#include <notes/result.h>
+#include <notes/search.h>
 #include <display/input.h>
 #include <display/display.h>
 #include <display/text_input.h>
 
-//https://www.sqlite.org/fts5.html
-#define CREATE_NOTES_TABLE  "CREATE VIRTUAL TABLE Notes USING fts5(title, body);"
-#define SELECT_FORMAT       "SELECT `rowid`, * FROM `Notes` WHERE `rowid`=?"
-#define DELETE_FORMAT       "DELETE FROM `Notes` WHERE `rowid`=?"
-#define SAERCH_FORMAT       "SELECT `rowid`, * FROM `Notes` WHERE `title` MATCH ? OR `body` MATCH ? ORDER BY rank"
-#define INSERT_FORMAT       "INSERT INTO `Notes` (`title`, `body`) VALUES (?, ?)"
-#define LIST_FORMAT       "SELECT `rowid`, * FROM `Notes`"
-
-typedef struct NotesQueryNode NotesQueryNode;
-struct NotesQueryNode {
-	int id;
-	char* title;
-	char* body;
-	NotesQueryNode* next;
+// Note rows live in NoteData with the body stored last so that reading the
+// other columns never touches its overflow pages. Bodies are kept as an LZ
+// compressed BLOB when that shrinks them (see db/functions.h) and size is
+// always the length of the text. Notes is an FTS5 index
+// (https://www.sqlite.org/fts5.html) whose external content is the NoteText
+// view, so snippets and the tokenizer see the text. Triggers keep it in sync.
+// The unique hash of the title and text is NULL only for rows found to be
+// duplicates when an older database was upgraded (see notes_dedupe) and for
+// notes whose hash collides with a different note
+#define NOTE_DATA_COLUMNS   "(`id` INTEGER PRIMARY KEY, `title` TEXT NOT NULL, " \
+	"`created` INTEGER NOT NULL, `updated` INTEGER NOT NULL, " \
+	"`size` INTEGER NOT NULL, `flags` INTEGER NOT NULL DEFAULT 0, " \
+	"`hash` INTEGER, `body` TEXT NOT NULL);"
+#define NOTE_DATA_INDEXES   "CREATE INDEX `NoteDataUpdated` ON `NoteData` (`updated`);" \
+	"CREATE UNIQUE INDEX `NoteDataHash` ON `NoteData` (`hash`);"
+#define CREATE_NOTE_DATA    "CREATE TABLE `NoteData` " NOTE_DATA_COLUMNS NOTE_DATA_INDEXES
+#define CREATE_NOTE_TEXT    "CREATE VIEW `NoteText` AS SELECT `id`, `title`, " \
+	"nc_body(`body`, `size`) AS `body` FROM `NoteData`;"
+// The prefix indexes keep the word* queries of search-as-you-type index only
+#define CREATE_NOTES_TABLE  "CREATE VIRTUAL TABLE `Notes` USING fts5(title, body, " \
+	"content='NoteText', content_rowid='id', prefix='2 3 4');"
+#define CREATE_NOTES_SYNC   "CREATE TRIGGER `NoteDataInsert` AFTER INSERT ON `NoteData` BEGIN " \
+	"INSERT INTO `Notes` (`rowid`, `title`, `body`) VALUES (new.`id`, new.`title`, nc_body(new.`body`, new.`size`)); END;" \
+	"CREATE TRIGGER `NoteDataDelete` AFTER DELETE ON `NoteData` BEGIN " \
+	"INSERT INTO `Notes` (`Notes`, `rowid`, `title`, `body`) VALUES ('delete', old.`id`, old.`title`, nc_body(old.`body`, old.`size`)); END;" \
+	"CREATE TRIGGER `NoteDataUpdate` AFTER UPDATE OF `title`, `body`, `size` ON `NoteData` BEGIN " \
+	"INSERT INTO `Notes` (`Notes`, `rowid`, `title`, `body`) VALUES ('delete', old.`id`, old.`title`, nc_body(old.`body`, old.`size`));" \
+	"INSERT INTO `Notes` (`rowid`, `title`, `body`) VALUES (new.`id`, new.`title`, nc_body(new.`body`, new.`size`)); END;"
+#define HASH_NOTES          "UPDATE OR IGNORE `NoteData` SET `hash`=nc_hash(`title`, nc_body(`body`, `size`)) WHERE `hash` IS NULL;"
+#define COMPRESS_BODIES     "UPDATE `NoteData` SET `body`=nc_compress(`body`) WHERE typeof(`body`)='text';"
+// Single row inserts leave a small segment each, automerge waits for 8 of
+// them on a level so writes stay cheap and idle time merges the rest
+#define TUNE_MERGE          "INSERT INTO `Notes` (`Notes`, rank) VALUES ('automerge', 8);" \
+	"INSERT INTO `Notes` (`Notes`, rank) VALUES ('crisismerge', 32);"
+#define CREATE_SCHEMA       CREATE_NOTE_DATA CREATE_NOTE_TEXT CREATE_NOTES_TABLE TUNE_MERGE CREATE_NOTES_SYNC
+// Databases from before NoteData hold everything in a plain FTS5 table, the
+// rows are copied out, the index is rebuilt in one pass, and then the
+// triggers take over
+#define MIGRATE_LEGACY      CREATE_NOTE_DATA CREATE_NOTE_TEXT \
+	"INSERT INTO `NoteData` (`id`, `title`, `created`, `updated`, `size`, `body`) " \
+	"SELECT `rowid`, `title`, unixepoch(), unixepoch(), length(CAST(`body` AS BLOB)), `body` FROM `Notes`;" \
+	HASH_NOTES COMPRESS_BODIES "DROP TABLE `Notes`;" CREATE_NOTES_TABLE TUNE_MERGE \
+	"INSERT INTO `Notes` (`Notes`) VALUES ('rebuild');" CREATE_NOTES_SYNC
+// Indexes over plain NoteData bodies (with or without prefix indexes) are
+// dropped along with their triggers while the bodies are compressed
+#define MIGRATE_COMPRESS    "DROP TRIGGER `NoteDataInsert`; DROP TRIGGER `NoteDataDelete`;" \
+	"DROP TRIGGER `NoteDataUpdate`; DROP TABLE `Notes`;" CREATE_NOTE_TEXT COMPRESS_BODIES \
+	CREATE_NOTES_TABLE TUNE_MERGE "INSERT INTO `Notes` (`Notes`) VALUES ('rebuild');" \
+	CREATE_NOTES_SYNC
+// The hash goes in front of the body, so NoteData is copied into a new table
+// (keeping every id so the index stays valid) before the notes are hashed
+#define MIGRATE_HASH        "DROP VIEW `NoteText`; CREATE TABLE `NoteDataNew` " NOTE_DATA_COLUMNS \
+	"INSERT INTO `NoteDataNew` (`id`, `title`, `created`, `updated`, `size`, `flags`, `body`) " \
+	"SELECT `id`, `title`, `created`, `updated`, `size`, `flags`, `body` FROM `NoteData`;" \
+	"DROP TABLE `NoteData`; ALTER TABLE `NoteDataNew` RENAME TO `NoteData`;" \
+	NOTE_DATA_INDEXES CREATE_NOTE_TEXT HASH_NOTES CREATE_NOTES_SYNC
+// The optional substring index holds the trigrams of the same text, a phrase
+// of trigrams matches any run of 3 or more characters wherever it is in a word
+// (https://www.sqlite.org/fts5.html#the_trigram_tokenizer). Phrase queries
+// need token positions so detail is left full. It is built and dropped on
+// request and has triggers of its own, so it is not part of the layout version
+#define CREATE_TRIGRAM      "CREATE VIRTUAL TABLE `NotesTrigram` USING fts5(title, body, " \
+	"content='NoteText', content_rowid='id', tokenize='trigram');" \
+	"INSERT INTO `NotesTrigram` (`NotesTrigram`, rank) VALUES ('automerge', 8);" \
+	"INSERT INTO `NotesTrigram` (`NotesTrigram`, rank) VALUES ('crisismerge', 32);" \
+	"INSERT INTO `NotesTrigram` (`NotesTrigram`) VALUES ('rebuild');" \
+	"CREATE TRIGGER `NoteDataTrigramInsert` AFTER INSERT ON `NoteData` BEGIN " \
+	"INSERT INTO `NotesTrigram` (`rowid`, `title`, `body`) VALUES (new.`id`, new.`title`, nc_body(new.`body`, new.`size`)); END;" \
+	"CREATE TRIGGER `NoteDataTrigramDelete` AFTER DELETE ON `NoteData` BEGIN " \
+	"INSERT INTO `NotesTrigram` (`NotesTrigram`, `rowid`, `title`, `body`) VALUES ('delete', old.`id`, old.`title`, nc_body(old.`body`, old.`size`)); END;" \
+	"CREATE TRIGGER `NoteDataTrigramUpdate` AFTER UPDATE OF `title`, `body`, `size` ON `NoteData` BEGIN " \
+	"INSERT INTO `NotesTrigram` (`NotesTrigram`, `rowid`, `title`, `body`) VALUES ('delete', old.`id`, old.`title`, nc_body(old.`body`, old.`size`));" \
+	"INSERT INTO `NotesTrigram` (`rowid`, `title`, `body`) VALUES (new.`id`, new.`title`, nc_body(new.`body`, new.`size`)); END;"
+#define DROP_TRIGRAM        "DROP TRIGGER `NoteDataTrigramInsert`; DROP TRIGGER `NoteDataTrigramDelete`;" \
+	"DROP TRIGGER `NoteDataTrigramUpdate`; DROP TABLE `NotesTrigram`;"
+// PRAGMA user_version is the layout a database has, it is read straight from
+// the file header. Databases from before it was kept are stamped once after
+// their layout is worked out from sqlite_master
+#define SCHEMA_NONE         0
+#define SCHEMA_LEGACY       1
+#define SCHEMA_NOTE_DATA    2
+#define SCHEMA_COMPRESSED   3
+#define SCHEMA_HASHED       4
+#define SCHEMA_VERSION      SCHEMA_HASHED
+// Rows left without a hash are duplicates, they are only removed once their
+// text is confirmed equal to the note that holds the hash
+#define DEDUPE_FORMAT       "DELETE FROM `NoteData` AS d WHERE d.`hash` IS NULL AND EXISTS (" \
+	"SELECT 1 FROM `NoteData` AS o WHERE o.`hash`=nc_hash(d.`title`, nc_body(d.`body`, d.`size`)) " \
+	"AND o.`title`=d.`title` AND nc_body(o.`body`, o.`size`)=nc_body(d.`body`, d.`size`))"
+#define POLL_INPUT_DELAY    1
+#define MERGE_FORMAT        "INSERT INTO `Notes` (`Notes`, rank) VALUES ('merge', ?)"
+#define MERGE_TRIGRAM       "INSERT INTO `NotesTrigram` (`NotesTrigram`, rank) VALUES ('merge', ?)"
+#define OPTIMIZE_FORMAT     "INSERT INTO `Notes` (`Notes`) VALUES ('optimize')"
+#define OPTIMIZE_TRIGRAM    "INSERT INTO `NotesTrigram` (`NotesTrigram`) VALUES ('optimize')"
+#define SEGMENTS_FORMAT     "SELECT count(DISTINCT `segid`) FROM `Notes_idx`"
+#define MAINTAIN_IDLE       3.0
+#define MAINTAIN_BUDGET     0.02
+#define MAINTAIN_PAGES      16
+#define COMPACT_PAGES       256
+#define SCHEMA_FORMAT       "SELECT 1 FROM `sqlite_master` WHERE `name`=? AND `sql` LIKE ?"
+#define USER_VERSION_FORMAT "PRAGMA user_version"
+#define LIVE_DEBOUNCE       0.15
+#define LIVE_MIN_PREFIX     2
+#define SELECT_FORMAT       "SELECT `id`, `title`, nc_body(`body`, `size`) FROM `NoteData` WHERE `id`=?"
+// Ids and ranges arrive as a JSON array of [first, last] pairs
+#define DELETE_IDS_FORMAT   "DELETE FROM `NoteData` WHERE `id` IN (SELECT d.`id` FROM json_each(?) AS r " \
+	"JOIN `NoteData` AS d ON d.`id` BETWEEN json_extract(r.`value`, '$[0]') AND json_extract(r.`value`, '$[1]'))"
+#define DELETE_MATCH_FORMAT "DELETE FROM `NoteData` WHERE `id` IN (SELECT `rowid` FROM `Notes` WHERE `Notes` MATCH ?)"
+#define COUNT_MATCH_FORMAT  "SELECT count(*) FROM `Notes` WHERE `Notes` MATCH ?"
+#define DELETE_PROGRESS_OPS 10000
+// Results are ranked by bm25 with a weight per column. Ordering by the score
+// with a LIMIT keeps only the best window while the matches are scored,
+// rather than the FTS5 rank sorter which sorts every match, and snippets are
+// only made for rows that reach the window. The first window has no keyset
+// to compare against, so each match is scored once rather than twice
+#define SEARCH_FIRST_FORMAT "SELECT `rowid`, bm25(`Notes`, ?9, ?10) AS `score`, substr(highlight(`Notes`, 0, ?2, ?3), 1, ?1), snippet(`Notes`, 1, ?2, ?3, '...', ?4) FROM `Notes` WHERE `Notes` MATCH ?5 ORDER BY `score`, `rowid` LIMIT ?8"
+#define SAERCH_FORMAT       "SELECT `rowid`, bm25(`Notes`, ?9, ?10) AS `score`, substr(highlight(`Notes`, 0, ?2, ?3), 1, ?1), snippet(`Notes`, 1, ?2, ?3, '...', ?4) FROM `Notes` WHERE `Notes` MATCH ?5 AND (`score`, `rowid`) > (?6, ?7) ORDER BY `score`, `rowid` LIMIT ?8"
+#define SNIPPET_TOKENS      16
+// Substring matches come back in id order, so a window stops at its LIMIT
+// rather than ranking every note that holds the text
+#define GREP_FORMAT         "SELECT `rowid`, 0.0, substr(highlight(`NotesTrigram`, 0, ?2, ?3), 1, ?1), snippet(`NotesTrigram`, 1, ?2, ?3, '...', ?4) FROM `NotesTrigram` WHERE `NotesTrigram` MATCH ?5 AND `rowid` > ?6 ORDER BY `rowid` LIMIT ?7"
+// Without the index (or for text too short to have a trigram) every note
+// is read until a window is found
+#define GREP_SCAN_FORMAT    "SELECT `id`, 0.0, substr(`title`, 1, ?1), substr(nc_body(`body`, `size`), max(1, instr(lower(nc_body(`body`, `size`)), lower(?5)) - ?4), ?1) FROM `NoteData` WHERE `id` > ?6 AND (instr(lower(`title`), lower(?5)) OR instr(lower(nc_body(`body`, `size`)), lower(?5))) ORDER BY `id` LIMIT ?7"
+#define GREP_SNIPPET_TOKENS 48
+#define GREP_SCAN_CONTEXT   24
+#define GREP_MIN_INDEXED    3
+#define TRIGRAM_PROGRESS_OPS 100000
+#define SNIPPET_INDENT      "    "
+#define INSERT_FORMAT       "INSERT INTO `NoteData` (`title`, `created`, `updated`, `size`, `hash`, `body`) VALUES (?1, unixepoch(), unixepoch(), ?3, ?4, ?2) ON CONFLICT (`hash`) DO NOTHING"
+// A note taking a hash is only a copy when its text matches too, rows that
+// collided were stored without a hash
+#define HASH_FORMAT         "SELECT `id` FROM `NoteData` WHERE (`hash`=?1 OR `hash` IS NULL) " \
+	"AND `title`=?2 AND `size`=?4 AND nc_body(`body`, `size`)=nc_body(?3, ?4) LIMIT 1"
+#define JSON_NOTE_FORMAT    "SELECT json_extract(?1, '$.title'), json_extract(?1, '$.body') WHERE json_valid(?1)"
+#define ARCHIVE_CHUNK_SIZE  (1024 * 1024)
+#define ARCHIVE_MAX_NOTE    (64 * 1024 * 1024)
+#define ARCHIVE_DELIMITER   "%%"
+#define IMPORT_QUEUE_SIZE   256
+#define IMPORT_STATUS_MS    100
+#define LIST_FORMAT         "SELECT `id`, substr(`title`, 1, ?) FROM `NoteData` WHERE `id` > ? ORDER BY `id` LIMIT ?"
+
+typedef enum {
+	NOTES_IMPORT_OK,
+	NOTES_IMPORT_OPEN_FAILED,
+	NOTES_IMPORT_NO_TITLE,
+	NOTES_IMPORT_NO_BODY,
+	NOTES_IMPORT_WRITE_FAILED,
+	NOTES_IMPORT_DUPLICATE,
+	NOTES_IMPORT_INVALID_TEXT,
+} NotesImportResult;
+
+typedef enum {
+	NOTES_WRITE_OK,
+	NOTES_WRITE_FAILED,
+	NOTES_WRITE_DUPLICATE,
+	NOTES_WRITE_NO_FILE,
+} NotesWriteResult;
+
+/* Time (in microseconds) spent in each stage of a threaded import */
+typedef struct {
+	int32_t readers;
+	atomic_llong read;
+	atomic_llong prepare;
+	atomic_llong readerWait;
+	atomic_llong readerBlocked;
+	atomic_llong write;
+	atomic_llong writerWait;
+} NotesImportStages;
+
+/* A batched import of files or archive notes, what names them in the status */
+typedef struct {
+	Notes* notes;
+	InputState* state;
+	const char* what;
+	double start;
+	int64_t items;
+	int64_t bytes;
+	int64_t skipped;
+	int64_t duplicates;
+	int32_t batchItems;
+	int64_t batchBytes;
+	NotesImportStages* stages;
+} NotesImport;
+
+/* Walker thread -> paths -> reader threads -> records -> the writer (caller) */
+typedef struct {
+	const char* root;
+	Queue* paths;
+	Queue* records;
+	NotesImportStages stages;
+	atomic_int readers;
+	atomic_bool walkFailed;
+} NotesImportPipeline;
+
+/* A file read and prepared by a reader thread, waiting for the writer */
+typedef struct {
+	NotesImportResult res;
+	size_t bytes;
+	int64_t titleLen;
+	int64_t storedLen;
+	int64_t size;
+	int64_t hash;
+	bool packed;
+	char data[];	/* The title followed by the stored body */
+} NotesImportRecord;
+
+/* Streaming parse state of a JSONL or bundle archive, one note is buffered */
+typedef struct {
+	NotesImport* import;
+	bool jsonl;
+	char* note;
+	size_t len;
+	size_t capacity;
+	size_t lineLen;
+	char lineHead[4];
+	Utf8Stream utf8;
+	bool skip;
+} NotesArchive;
+
+typedef enum {
+	NOTES_PAGER_LIST,
+	NOTES_PAGER_SEARCH,
+	NOTES_PAGER_GREP,
+	NOTES_PAGER_SCAN,
+} NotesPagerMode;
+
+/* Keyset position of a paged list or search, one window is about a screen */
+struct NotesPager {
+	NotesPagerMode mode;
+	InputState* state;
+	char* term;
+	char* screen;
+	int64_t lastId;
+	double lastRank;
+	int32_t window;
+	int32_t cols;
+	uint32_t session;
+	int inputDelay;
 };
 
+typedef enum {
+	NOTES_WINDOW_LIST,
+	NOTES_WINDOW_SEARCH,
+	NOTES_WINDOW_LIVE,
+	NOTES_WINDOW_PAGE,
+} NotesWindowKind;
+
+/* A window fetched on the worker thread from a copy of the pager position */
 typedef struct {
-	NotesQueryNode head;
-	NotesQueryNode* current;
-	int count;
-} NotesQueryList;
-
-static inline size_t local_read_text_file(const char* path, char** outString) {
-	FILE* fp = NULL;
-	fopen_s(&fp, path, "r");
-	if (fp == NULL) {
-		*outString = NULL;
-		return 0;
-	}
-	fseek(fp, 0L, SEEK_END);
-	size_t length = ftell(fp) + 1;
-	rewind(fp);
-	*outString = (char*)calloc(1, length);
-	fread(*outString, length - 1, 1, fp);
-	fclose(fp);
-	//(*outString)[length - 1] = '\0';
-	return length;
+	DbJob job;
+	Notes* notes;
+	NotesWindowKind kind;
+	NotesPagerMode mode;
+	uint32_t session;
+	char* term;
+	char* text;
+	int64_t lastId;
+	double lastRank;
+	double titleWeight;
+	double bodyWeight;
+	int32_t window;
+	int32_t cols;
+	int32_t rows;
+	double elapsed;
+	NotesResult result;
+} NotesWindowJob;
+
+static inline double local_now() {
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0;
 }
 
-static inline void local_notes_query_free(NotesQueryNode* query) {
-	free(query->title);
-	free(query->body);
-	if (query->next != NULL) {
-		local_notes_query_free(query->next);
-		free(query->next);
-	}
+/* One upgrade, every step starting at the version of a database is run in order */
+typedef struct {
+	int32_t from;
+	int32_t to;
+	const char* sql;
+} NotesMigration;
+
+static const NotesMigration s_migrations[] = {
+	{ SCHEMA_NONE, SCHEMA_VERSION, CREATE_SCHEMA },
+	{ SCHEMA_LEGACY, SCHEMA_VERSION, MIGRATE_LEGACY },
+	{ SCHEMA_NOTE_DATA, SCHEMA_COMPRESSED, MIGRATE_COMPRESS },
+	{ SCHEMA_COMPRESSED, SCHEMA_HASHED, MIGRATE_HASH },
+};
+
+static inline bool local_schema_contains(Notes* notes, const char* name, const char* pattern) {
+	sqlite3_stmt* pStmt = query_cache_get(notes->queries, SCHEMA_FORMAT);
+	if (pStmt == NULL)
+		return false;
+	query_bind_text(pStmt, 1, name, -1);
+	query_bind_text(pStmt, 2, pattern, -1);
+	bool found = query_step(pStmt) == QUERY_ROW;
+	query_done(pStmt);
+	return found;
 }
 
-static inline void local_query_list_free(NotesQueryList* list) {
-	local_notes_query_free(&list->head);
-	free(list);
+/* Works out the layout of a database that has no user_version yet */
+static int32_t local_unversioned_schema(Notes* notes) {
+	if (!local_schema_contains(notes, "NoteData", "%"))
+		return local_schema_contains(notes, "Notes", "%") ? SCHEMA_LEGACY : SCHEMA_NONE;
+	else if (!local_schema_contains(notes, "Notes", "%content='NoteText'%"))
+		return SCHEMA_NOTE_DATA;
+	else if (!local_schema_contains(notes, "NoteData", "%`hash`%"))
+		return SCHEMA_COMPRESSED;
+	return SCHEMA_HASHED;
 }
 
-static inline int init(Notes* notes) {
-	int err = query_run(notes->db, "SELECT * FROM `Notes` LIMIT 1");
+static int32_t local_schema_version(Notes* notes) {
+	sqlite3_stmt* pStmt = query_cache_get(notes->queries, USER_VERSION_FORMAT);
+	if (pStmt == NULL)
+		return -1;
+	int32_t version = query_step(pStmt) == QUERY_ROW ? sqlite3_column_int(pStmt, 0) : -1;
+	query_done(pStmt);
+	return version;
+}
+
+/* The upgrade and the new user_version are committed together */
+static int local_migrate(Notes* notes, const NotesMigration* step) {
+	int err = query_exec(notes->db, "BEGIN;");
+	if (!err)
+		err = query_exec(notes->db, step->sql);
+	if (!err)
+		err = query_run(notes->db, "PRAGMA user_version=%d;", step->to);
+	if (!err)
+		err = query_exec(notes->db, "COMMIT;");
 	if (err)
-		err = query_run(notes->db, CREATE_NOTES_TABLE);
+		query_exec(notes->db, "ROLLBACK;");
 	return err;
 }
 
-static inline int wite_note(Notes* notes, const char* title, const char* body) {
-	sqlite3_stmt* pStmt = NULL;
-	char* writeBody = body;
-	bool fromFile = stridxof(body, "file:", 0) == 0;
-	if (fromFile) {
-		if (local_read_text_file(body + 5, &writeBody) == 0)
-			return -1;
-	}
-	int err = sqlite3_prepare_v2(notes->db, INSERT_FORMAT, -1, &pStmt, NULL);
-	if (!err) {
-		sqlite3_bind_text(pStmt, 1, title, (int)strlen(title), NULL);
-		sqlite3_bind_text(pStmt, 2, writeBody, (int)strlen(writeBody), NULL);
-		if (sqlite3_step(pStmt) != SQLITE_DONE) {
-			//sqlite3_errmsg
-			return -1;
+static inline int init(Notes* notes) {
+	// An unreadable header (not a database, or corrupt) fails here, as does a
+	// database written by a newer version of the program
+	int32_t stamped = local_schema_version(notes);
+	if (stamped < 0 || stamped > SCHEMA_VERSION)
+		return QUERY_ERR;
+	int32_t version = stamped;
+	if (version == SCHEMA_NONE)
+		version = local_unversioned_schema(notes);
+	int err = QUERY_OK;
+	for (size_t i = 0; !err && i < sizeof(s_migrations) / sizeof(*s_migrations); ++i) {
+		if (s_migrations[i].from == version) {
+			err = local_migrate(notes, &s_migrations[i]);
+			version = stamped = s_migrations[i].to;
 		}
-		err = sqlite3_finalize(pStmt);
 	}
-	if (fromFile)
-		free(writeBody);
+	// A current database from before versioning only needs its stamp
+	if (!err && stamped != version)
+		err = query_run(notes->db, "PRAGMA user_version=%d;", version);
+	if (!err)
+		notes->trigramIndex = local_schema_contains(notes, "NotesTrigram", "%");
 	return err;
 }
 
-static void local_print_listing(char* buff, int buffSize,
-	NotesQueryNode* q, int w, InputState* state)
+/* The note with this hash and the same title and text, 0 if there is none */
+static int64_t local_find_copy(Notes* notes, const char* title, int64_t titleLen,
+	const void* body, int64_t storedLen, bool packed, int64_t size, int64_t hash)
+{
+	sqlite3_stmt* pStmt = query_cache_get(notes->queries, HASH_FORMAT);
+	if (pStmt == NULL)
+		return 0;
+	query_bind_int64(pStmt, 1, hash);
+	query_bind_text(pStmt, 2, title, titleLen);
+	if (packed)
+		query_bind_blob(pStmt, 3, body, storedLen);
+	else
+		query_bind_text(pStmt, 3, body, storedLen);
+	query_bind_int64(pStmt, 4, size);
+	int64_t id = query_step(pStmt) == QUERY_ROW ? sqlite3_column_int64(pStmt, 0) : 0;
+	query_done(pStmt);
+	return id;
+}
+
+/* Returns 1 when the row went in, 0 when the hash is already taken and -1 on
+ * failure. A NULL hash never conflicts */
+static int local_insert_row(Notes* notes, const char* title, int64_t titleLen,
+	const void* body, int64_t storedLen, bool packed, int64_t size, const int64_t* hash)
 {
-	snprintf(buff, buffSize, "(%d) %s\n", q->id, q->title);
-	if (strlen(buff) > w - 4) {
-		buff[w - 1] = '\0';
-		buff[w - 2] = '\n';
-		buff[w - 3] = '.';
-		buff[w - 4] = '.';
-		buff[w - 5] = '.';
+	sqlite3_stmt* pStmt = query_cache_get(notes->queries, INSERT_FORMAT);
+	if (pStmt == NULL)
+		return -1;
+	query_bind_text(pStmt, 1, title, titleLen);
+	if (packed)
+		query_bind_blob(pStmt, 2, body, storedLen);
+	else
+		query_bind_text(pStmt, 2, body, storedLen);
+	query_bind_int64(pStmt, 3, size);
+	if (hash != NULL)
+		query_bind_int64(pStmt, 4, *hash);
+	else
+		query_bind_null(pStmt, 4);
+	int res = query_step(pStmt) == QUERY_OK ? sqlite3_changes(notes->db) > 0 : -1;
+	query_done(pStmt);
+	return res;
+}
+
+/* The body is already hashed and, when packed, LZ compressed to storedLen bytes */
+static NotesWriteResult local_insert_note(Notes* notes, const char* title, int64_t titleLen,
+	const void* body, int64_t storedLen, bool packed, int64_t size, int64_t hash, int64_t* outId)
+{
+	*outId = 0;
+	int res = local_insert_row(notes, title, titleLen, body, storedLen, packed, size, &hash);
+	if (res == 0) {
+		// The hash is taken, but only a note with the same text is a copy.
+		// Anything else is a collision and is kept without a hash
+		*outId = local_find_copy(notes, title, titleLen, body, storedLen, packed, size, hash);
+		if (*outId != 0)
+			return NOTES_WRITE_DUPLICATE;
+		res = local_insert_row(notes, title, titleLen, body, storedLen, packed, size, NULL);
 	}
-	ui_print_wrap(state->ui, buff);
+	if (res <= 0)
+		return NOTES_WRITE_FAILED;
+	*outId = sqlite3_last_insert_rowid(notes->db);
+	notes->maintenancePending = true;
+	return NOTES_WRITE_OK;
 }
 
-Notes* notes_new(volatile const bool* const prgSig) {
+/* outId is the new note, or the note it duplicates */
+static NotesWriteResult local_write_note(Notes* notes, const char* title,
+	int64_t titleLen, const char* body, int64_t bodyLen, int64_t* outId)
+{
+	if (titleLen < 0)
+		titleLen = (int64_t)strlen(title);
+	if (bodyLen < 0)
+		bodyLen = (int64_t)strlen(body);
+	int64_t hash = db_note_hash(title, (size_t)titleLen, body, (size_t)bodyLen);
+	void* packed;
+	size_t packedLen = db_compress_body(body, (size_t)bodyLen, &packed);
+	NotesWriteResult res = packedLen > 0
+		? local_insert_note(notes, title, titleLen, packed, (int64_t)packedLen, true, bodyLen, hash, outId)
+		: local_insert_note(notes, title, titleLen, body, bodyLen, false, bodyLen, hash, outId);
+	free(packed);
+	return res;
+}
+
+/* Loads the vocabulary in the background when there is none or it is stale,
+ * the one already loaded keeps serving completions until then */
+static void local_vocab_refresh(Notes* notes) {
+	if (notes->vocabLoader != NULL || (notes->vocab != NULL && !notes->vocabStale))
+		return;
+	notes->vocabStale = false;
+	notes->vocabLoader = vocab_loader_start(NOTES_DB_PATH, notes->snapshot);
+}
+
+/* Notes went away or came in without being counted, a vocabulary that is in
+ * use is loaded again right away rather than on the next search */
+static void local_vocab_stale(Notes* notes) {
+	notes->vocabStale = true;
+	if (notes->vocab != NULL)
+		local_vocab_refresh(notes);
+}
+
+static void local_vocab_poll(Notes* notes) {
+	NotesVocab* vocab;
+	if (notes->vocabLoader == NULL || !vocab_loader_poll(notes->vocabLoader, &vocab))
+		return;
+	notes->vocabLoader = NULL;
+	if (vocab != NULL && !vocab_open_tokenizer(vocab, notes->db)) {
+		vocab_free(vocab);
+		vocab = NULL;
+	}
+	if (vocab != NULL) {
+		if (notes->vocab != NULL)
+			vocab_free(notes->vocab);
+		notes->vocab = vocab;
+	}
+	// Whatever changed while it was loading may not be in it
+	if (notes->vocabStale && notes->vocab != NULL)
+		local_vocab_refresh(notes);
+}
+
+/* Counts a written note into the completion vocabulary */
+static void local_vocab_note_added(Notes* notes, const char* title,
+	size_t titleLen, const char* body, size_t bodyLen)
+{
+	// A vocabulary being loaded may not see the note, so it is loaded again
+	if (notes->vocabLoader != NULL)
+		notes->vocabStale = true;
+	else if (notes->vocab != NULL && !vocab_add_note(notes->vocab,
+		title, (int32_t)titleLen, body, (int32_t)bodyLen))
+	{
+		local_vocab_stale(notes);
+	}
+}
+
+static inline NotesWriteResult wite_note(Notes* notes, const char* title,
+	const char* body, int64_t* outId)
+{
+	NotesWriteResult res;
+	if (stridxof(body, "file:", 0) != 0) {
+		res = local_write_note(notes, title, -1, body, -1, outId);
+		if (res == NOTES_WRITE_OK)
+			local_vocab_note_added(notes, title, strlen(title), body, strlen(body));
+		return res;
+	}
+	FileView view;
+	if (!file_view_open(body + 5, &view))
+		return NOTES_WRITE_NO_FILE;
+	res = local_write_note(notes, title, -1, view.data, (int64_t)view.size, outId);
+	if (res == NOTES_WRITE_OK)
+		local_vocab_note_added(notes, title, strlen(title), view.data, view.size);
+	file_view_close(&view);
+	return res;
+}
+
+static int local_format_listing(char* buff, int buffSize,
+	int id, const char* title, int w)
+{
+	int len = snprintf(buff, buffSize, "(%d) %s\n", id, title);
+	bool truncated = len >= buffSize;
+	if (truncated)
+		len = buffSize - 1;
+	// Highlight markers and UTF-8 continuation bytes take no columns. A line
+	// wider than the screen is cut at a character and ends with "..." (the
+	// UI turns a highlight off at the end of the line)
+	int keep = w > 5 ? w - 5 : 0;
+	int visible = 0;
+	int cut = -1;
+	for (int i = 0; i < len && buff[i] != '\n'; ++i) {
+		unsigned char c = (unsigned char)buff[i];
+		if (c == UI_HIGHLIGHT_START[0] || c == UI_HIGHLIGHT_END[0] || (c & 0xC0) == 0x80)
+			continue;
+		if (visible++ == keep)
+			cut = i;
+	}
+	if (cut < 0 && truncated)
+		cut = len;
+	if (cut >= 0) {
+		int dots = w >= 5 ? 3 : 0;
+		while (cut > 0 && cut + dots + 2 > buffSize)
+			cut--;
+		while (cut > 0 && ((unsigned char)buff[cut] & 0xC0) == 0x80)
+			cut--;
+		memset(buff + cut, '.', (size_t)dots);
+		len = cut + dots;
+		buff[len++] = '\n';
+		buff[len] = '\0';
+	}
+	return len;
+}
+
+static int local_format_snippet(char* buff, int buffSize, const char* snippet, int w) {
+	int limit = (w < buffSize ? w : buffSize) - 2;
+	int len = snprintf(buff, buffSize, "%s", SNIPPET_INDENT);
+	for (; *snippet != '\0' && len < limit; ++snippet) {
+		char c = *snippet;
+		if (c == '\n' || c == '\r' || c == '\t')
+			c = ' ';
+		if (c != ' ' || buff[len - 1] != ' ')
+			buff[len++] = c;
+	}
+	if (*snippet != '\0') {
+		// Do not leave half of a UTF-8 sequence at the cut
+		while (len > 0 && ((unsigned char)buff[len - 1] & 0xC0) == 0x80)
+			len--;
+		if (len > 0 && (unsigned char)buff[len - 1] >= 0xC0)
+			len--;
+	}
+	buff[len++] = '\n';
+	buff[len] = '\0';
+	return len;
+}
+
+static void local_pager_begin(Notes* notes, InputState* state,
+	NotesPagerMode mode, const char* term)
+{
+	NotesPager* pager = notes->pager;
+	int w, h;
+	display_get_rows_cols(&h, &w);
+	assert(w <= 512);
+	// Windows still in flight belong to the previous list or search
+	pager->session++;
+	if (notes->worker != NULL)
+		db_worker_cancel(notes->worker);
+	pager->mode = mode;
+	pager->state = state;
+	pager->lastId = INT64_MIN;
+	pager->lastRank = -DBL_MAX;
+	// Search results take a title and a snippet line each
+	pager->window = mode != NOTES_PAGER_LIST ? (h + 1) / 2 : h;
+	pager->cols = w;
+	pager->screen = realloc(pager->screen, (size_t)(h + 1) * 512);
+	strcloneclr(term != NULL ? term : "", &pager->term);
+}
+
+/* Runs on the worker thread, so it may only touch the job and the connection */
+static void local_window_run(DbJob* job, sqlite3* db, QueryCache* queries) {
+	NotesWindowJob* win = (NotesWindowJob*)job;
+	double start = local_now();
+	sqlite3_stmt* pStmt;
+	if (win->mode == NOTES_PAGER_LIST) {
+		pStmt = query_cache_get(queries, LIST_FORMAT);
+		if (pStmt == NULL) {
+			win->rows = -1;
+			return;
+		}
+		query_bind_int(pStmt, 1, win->cols);
+		query_bind_int64(pStmt, 2, win->lastId);
+		query_bind_int(pStmt, 3, win->window);
+	} else if (win->mode == NOTES_PAGER_SEARCH) {
+		pStmt = query_cache_get(queries, win->lastId == INT64_MIN ? SEARCH_FIRST_FORMAT : SAERCH_FORMAT);
+		if (pStmt == NULL) {
+			win->rows = -1;
+			return;
+		}
+		query_bind_int(pStmt, 1, win->cols);
+		query_bind_text(pStmt, 2, UI_HIGHLIGHT_START, -1);
+		query_bind_text(pStmt, 3, UI_HIGHLIGHT_END, -1);
+		query_bind_int(pStmt, 4, SNIPPET_TOKENS);
+		query_bind_text(pStmt, 5, win->term, -1);
+		query_bind_double(pStmt, 6, win->lastRank);
+		query_bind_int64(pStmt, 7, win->lastId);
+		query_bind_int(pStmt, 8, win->window);
+		query_bind_double(pStmt, 9, win->titleWeight);
+		query_bind_double(pStmt, 10, win->bodyWeight);
+	} else {
+		bool scan = win->mode == NOTES_PAGER_SCAN;
+		pStmt = query_cache_get(queries, scan ? GREP_SCAN_FORMAT : GREP_FORMAT);
+		if (pStmt == NULL) {
+			win->rows = -1;
+			return;
+		}
+		query_bind_int(pStmt, 1, win->cols);
+		query_bind_text(pStmt, 2, UI_HIGHLIGHT_START, -1);
+		query_bind_text(pStmt, 3, UI_HIGHLIGHT_END, -1);
+		query_bind_int(pStmt, 4, scan ? GREP_SCAN_CONTEXT : GREP_SNIPPET_TOKENS);
+		query_bind_text(pStmt, 5, win->term, -1);
+		query_bind_int64(pStmt, 6, win->lastId);
+		query_bind_int(pStmt, 7, win->window);
+	}
+	int res;
+	notes_result_clear(&win->result);
+	while ((res = query_step(pStmt)) == QUERY_ROW) {
+		if (win->mode != NOTES_PAGER_LIST)
+			notes_result_add(&win->result, pStmt, 1, 2, 2);
+		else
+			notes_result_add(&win->result, pStmt, -1, 1, 1);
+	}
+	if (res == QUERY_ERR && sqlite3_errcode(db) == SQLITE_INTERRUPT)
+		job->cancelled = true;
+	query_done(pStmt);
+	win->rows = win->result.count;
+	win->elapsed = local_now() - start;
+}
+
+/* Formats a fetched window into the pager screen and moves the keyset past it */
+static void local_pager_take_window(NotesPager* pager, const NotesWindowJob* win) {
+	const NotesResult* result = &win->result;
+	int screenLen = 0;
+	pager->screen[0] = '\0';
+	for (int32_t i = 0; i < result->count; ++i) {
+		screenLen += local_format_listing(pager->screen + screenLen, 512,
+			(int)result->rows[i].id, notes_result_text(result, i, 0), pager->cols);
+		if (pager->mode != NOTES_PAGER_LIST) {
+			screenLen += local_format_snippet(pager->screen + screenLen, 512,
+				notes_result_text(result, i, 1), pager->cols);
+		}
+	}
+	if (result->count > 0) {
+		pager->lastId = result->rows[result->count - 1].id;
+		pager->lastRank = result->rows[result->count - 1].rank;
+	}
+}
+
+static void local_window_done(DbJob* job);
+
+void notes_run_job(Notes* notes, DbJob* job) {
+	// Without a worker (or with its queue full) the job is run right here
+	if (notes->worker == NULL || !db_worker_submit(notes->worker, job)) {
+		job->run(job, notes->db, notes->queries);
+		job->done(job);
+	} else if (notes->pager->inputDelay != POLL_INPUT_DELAY) {
+		// Poll for the result straight away rather than after the next key wait
+		display_set_input_delay(POLL_INPUT_DELAY);
+		notes->pager->inputDelay = POLL_INPUT_DELAY;
+	}
+}
+
+static void local_pager_fetch(Notes* notes, NotesWindowKind kind, const char* text) {
+	NotesPager* pager = notes->pager;
+	NotesWindowJob* win = calloc(1, sizeof(*win));
+	win->job.run = local_window_run;
+	win->job.done = local_window_done;
+	win->notes = notes;
+	win->kind = kind;
+	win->mode = pager->mode;
+	win->session = pager->session;
+	strclone(pager->term, &win->term);
+	if (text != NULL)
+		strclone(text, &win->text);
+	win->lastId = pager->lastId;
+	win->lastRank = pager->lastRank;
+	win->titleWeight = notes->titleWeight;
+	win->bodyWeight = notes->bodyWeight;
+	win->window = pager->window;
+	win->cols = pager->cols;
+	notes_result_init(&win->result);
+	notes_run_job(notes, &win->job);
+}
+
+static void local_pager_source(void* state, ClientUI* ui) {
+	local_pager_fetch(state, NOTES_WINDOW_PAGE, NULL);
+}
+
+static void local_show_page(Notes* notes, NotesWindowJob* win) {
+	ClientUI* ui = notes->pager->state->ui;
+	if (!ui_page_source_pending(ui))
+		return;
+	if (win->job.cancelled)
+		ui_page_source_cancel(ui);
+	else {
+		if (win->rows > 0) {
+			local_pager_take_window(notes->pager, win);
+			ui_append(ui, notes->pager->screen);
+		}
+		ui_page_source_done(ui, win->rows == win->window);
+	}
+}
+
+static void local_show_list(Notes* notes, NotesWindowJob* win) {
+	InputState* state = notes->pager->state;
+	if (win->rows < 0)
+		return;
+	if (win->rows == win->window)
+		ui_set_page_source(state->ui, local_pager_source, notes);
+	ui_print_wrap(state->ui, notes->pager->screen);
+}
+
+static void local_show_search(Notes* notes, NotesWindowJob* win) {
+	InputState* state = notes->pager->state;
+	if (win->rows < 0)
+		ui_clear_and_print(state->ui, "Failed to query the database");
+	else if (win->rows == 0)
+		ui_clear_and_print(state->ui, "Could not locate any matches");
+	else if (win->rows == 1)
+		notes_select(notes, state, (int32_t)notes->pager->lastId);
+	else {
+		// TODO:  Pick an option
+		ui_clear_and_print(state->ui, "Multiple entries found, pick an id...\n");
+		if (win->rows == win->window)
+			ui_set_page_source(state->ui, local_pager_source, notes);
+		ui_print_wrap(state->ui, notes->pager->screen);
+	}
+	ui_print_command_prompt(state->ui, state->command, ">\0", " \0");
+}
+
+static void local_show_live(Notes* notes, NotesWindowJob* win) {
+	InputState* state = notes->pager->state;
+	char header[512];
+	snprintf(header, sizeof(header), "%s%d match%s for \"%.200s\" (%.1f ms)\n",
+		win->rows == win->window ? "First " : "", win->rows < 0 ? 0 : win->rows,
+		win->rows == 1 ? "" : "es", win->text, win->elapsed * 1000.0);
+	ui_clear_and_print(state->ui, header);
+	if (win->rows > 0) {
+		if (win->rows == win->window)
+			ui_set_page_source(state->ui, local_pager_source, notes);
+		ui_print_wrap(state->ui, notes->pager->screen);
+	}
+	ui_print_command_prompt(state->ui, state->command, ">\0", " \0");
+}
+
+/* Runs on the UI thread once the worker hands the window back */
+static void local_window_done(DbJob* job) {
+	NotesWindowJob* win = (NotesWindowJob*)job;
+	Notes* notes = win->notes;
+	if (win->session == notes->pager->session) {
+		if (win->kind == NOTES_WINDOW_PAGE)
+			local_show_page(notes, win);
+		else if (!job->cancelled) {
+			local_pager_take_window(notes->pager, win);
+			if (win->kind == NOTES_WINDOW_LIST)
+				local_show_list(notes, win);
+			else if (win->kind == NOTES_WINDOW_SEARCH)
+				local_show_search(notes, win);
+			else
+				local_show_live(notes, win);
+		}
+	}
+	free(win->term);
+	free(win->text);
+	notes_result_free(&win->result);
+	free(win);
+}
+
+static void local_poll(Notes* notes, InputState* state) {
+	if (notes->worker == NULL)
+		return;
+	// Anything typed other than paging means the result is no longer wanted
+	bool typed = state->key != ERR && state->key != DKEY_PAGE_UP
+		&& state->key != DKEY_PAGE_DOWN;
+	if (db_worker_busy(notes->worker) && (*notes->prgSig || typed))
+		db_worker_cancel(notes->worker);
+	db_worker_poll(notes->worker);
+}
+
+Notes* notes_new(volatile const bool* const prgSig, const DbProfile* profile) {
 	Notes* notes = calloc(1, sizeof(*notes));
 	notes->prgSig = prgSig;
-	if (sqlite3_open("./nc.db", &notes->db) == 0) {
+	notes->profile = profile;
+	notes->importBatchSize = NOTES_IMPORT_BATCH_SIZE;
+	notes->importThreads = NOTES_IMPORT_THREADS;
+	notes->titleWeight = NOTES_TITLE_WEIGHT;
+	notes->bodyWeight = NOTES_BODY_WEIGHT;
+	// Earlier sessions may have left segments to merge
+	notes->idleSince = local_now();
+	notes->maintenancePending = true;
+	notes->pager = calloc(1, sizeof(*notes->pager));
+	notes->pager->inputDelay = DISPLAY_INPUT_DELAY;
+	if (sqlite3_open(NOTES_DB_PATH, &notes->db) == 0) {
+		sqlite3_busy_timeout(notes->db, DB_BUSY_TIMEOUT);
+		db_functions_register(notes->db);
+		notes->queries = query_cache_new(notes->db);
+		// The journal mode is switched first, before the worker connects
+		db_profile_apply(notes->db, profile, true);
 		int err = init(notes);
 		if (err) {
+			query_cache_free(notes->queries);
+			sqlite3_close(notes->db);
+			free(notes->pager);
 			free(notes);
 			return NULL;
-		} else
+		} else {
+			// Reads run on the worker, if it fails to start they run inline
+			notes->worker = db_worker_new(NOTES_DB_PATH, NULL, profile);
 			return notes;
+		}
 	} else {
+		free(notes->pager);
 		free(notes);
 		return NULL;
 	}
 }
 
 void notes_free(Notes* notes) {
+	// Windows the worker still holds are only cleaned up, never shown
+	notes->pager->session++;
+	if (notes->worker != NULL)
+		db_worker_free(notes->worker);
+	if (notes->vocabLoader != NULL)
+		vocab_loader_cancel(notes->vocabLoader);
+	if (notes->vocab != NULL)
+		vocab_free(notes->vocab);
+	query_cache_free(notes->queries);
 	sqlite3_close(notes->db);
+	if (notes->snapshot != NULL)
+		db_snapshot_free(notes->snapshot);
+	free(notes->pager->term);
+	free(notes->pager->screen);
+	free(notes->pager);
 	free(notes);
 }
 
-static void print_note(InputState* state, NotesQueryNode* q) {
+bool notes_snapshot(Notes* notes, InputState* state) {
+	char status[256];
+	sqlite3* db;
+	DbSnapshot* snapshot = db_snapshot_new(notes->db);
+	if (snapshot == NULL || !db_snapshot_open(snapshot, &db)) {
+		if (snapshot != NULL)
+			db_snapshot_free(snapshot);
+		ui_print_wrap(state->ui, "\nFailed to load the snapshot, notes are read from disk\n");
+		return false;
+	}
+	// Everything after this point is served from the image, the file is closed
+	if (notes->worker != NULL)
+		db_worker_free(notes->worker);
+	query_cache_free(notes->queries);
+	sqlite3_close(notes->db);
+	notes->db = db;
+	notes->snapshot = snapshot;
+	notes->maintenancePending = false;
+	db_functions_register(notes->db);
+	notes->queries = query_cache_new(notes->db);
+	notes->worker = db_worker_new(NULL, snapshot, NULL);
+	sqlite3_int64 resident = sqlite3_memory_used();
+	snprintf(status, sizeof(status),
+		"\nLoaded a read only snapshot of %.2f MB in %.3f sec, %.2f MB resident\n",
+		(double)snapshot->size / (1024.0 * 1024.0), snapshot->loadSeconds,
+		(double)resident / (1024.0 * 1024.0));
+	ui_print_wrap(state->ui, status);
+	return true;
+}
+
+static bool local_read_only(Notes* notes, InputState* state) {
+	if (notes->snapshot == NULL)
+		return false;
+	ui_clear_and_print(state->ui, "Notes are a read only snapshot, restart without --snapshot to change them");
+	return true;
+}
+
+static void print_note(InputState* state, const NotesResult* result, int32_t row) {
 	char output[4096];
 	snprintf(output, sizeof(output), "ID:    %d\nTitle: %s\n%s",
-		q->id, q->title, q->body);
+		(int)result->rows[row].id, notes_result_text(result, row, 0),
+		notes_result_text(result, row, 1));
 	ui_clear_and_print(state->ui, output);
 }
 
 void notes_select(Notes* notes, InputState* state, int32_t id) {
-	sqlite3_stmt* pStmt = NULL;
-	int err = sqlite3_prepare_v2(notes->db, SELECT_FORMAT, -1, &pStmt, NULL);
-	if (!err) {
-		sqlite3_bind_int(pStmt, 1, id);
-		if (sqlite3_step(pStmt) == SQLITE_ROW) {
-			NotesQueryNode q = { .id = 0, .title = NULL, .body = NULL, .next = NULL };
-			q.id = sqlite3_column_int(pStmt, 0);
-			strclone((const char*)sqlite3_column_text(pStmt, 1), &q.title);
-			strclone((const char*)sqlite3_column_text(pStmt, 2), &q.body);
-			print_note(state, &q);
-			local_notes_query_free(&q);
-		} else
+	sqlite3_stmt* pStmt = query_cache_get(notes->queries, SELECT_FORMAT);
+	if (pStmt != NULL) {
+		query_bind_int(pStmt, 1, id);
+		NotesResult result;
+		notes_result_init(&result);
+		if (query_step(pStmt) == QUERY_ROW)
+			notes_result_add(&result, pStmt, -1, 1, 2);
+		query_done(pStmt);
+		if (result.count > 0)
+			print_note(state, &result, 0);
+		else
 			ui_clear_and_print(state->ui, "Unable to locate the given note");
-		sqlite3_finalize(pStmt);
+		notes_result_free(&result);
 	}
 }
 
-void notes_delete(Notes* notes, InputState* state, int32_t id) {
-	sqlite3_stmt* pStmt = NULL;
-	int err = sqlite3_prepare_v2(notes->db, DELETE_FORMAT, -1, &pStmt, NULL);
-	if (!err) {
-		sqlite3_bind_int(pStmt, 1, id);
-		if (sqlite3_step(pStmt) == SQLITE_DONE)
-			ui_clear_and_print(state->ui, "The note has been deleted");
-		else
-			ui_clear_and_print(state->ui, "Unable to locate the given note");
-		sqlite3_finalize(pStmt);
-	} else
+/* Turns "3,9,27" or "100-5000" (or a mix) into JSON ranges, false otherwise */
+static bool local_parse_id_ranges(const char* spec, char** outJson) {
+	*outJson = NULL;
+	size_t len = 1;
+	size_t capacity = 64;
+	char* json = malloc(capacity);
+	json[0] = '[';
+	const char* c = spec;
+	bool any = false;
+	while (*c != '\0') {
+		while (isspace((unsigned char)*c) || *c == ',')
+			c++;
+		if (*c == '\0')
+			break;
+		char* next;
+		long long first = strtoll(c, &next, 10);
+		if (next == c || first < 0)
+			break;
+		long long last = first;
+		c = next;
+		while (isspace((unsigned char)*c))
+			c++;
+		if (*c == '-') {
+			last = strtoll(c + 1, &next, 10);
+			if (next == c + 1 || last < 0)
+				break;
+			c = next;
+			if (last < first) {
+				long long swap = first;
+				first = last;
+				last = swap;
+			}
+		}
+		while (isspace((unsigned char)*c))
+			c++;
+		if (*c != ',' && *c != '\0')
+			break;
+		if (capacity - len < 64) {
+			capacity *= 2;
+			json = realloc(json, capacity);
+		}
+		len += snprintf(json + len, capacity - len, "%s[%lld,%lld]", any ? "," : "", first, last);
+		any = true;
+	}
+	if (*c != '\0' || !any) {
+		free(json);
+		return false;
+	}
+	json[len++] = ']';
+	json[len] = '\0';
+	*outJson = json;
+	return true;
+}
+
+static int local_cancel_progress(void* state) {
+	return *((Notes*)state)->prgSig;
+}
+
+/* Runs one delete statement in its own transaction, -1 if it was undone */
+static int64_t local_delete_batch(Notes* notes, const char* sql, const char* arg) {
+	int64_t removed = -1;
+	if (query_cache_exec(notes->queries, "BEGIN") != QUERY_OK)
+		return -1;
+	sqlite3_stmt* pStmt = query_cache_get(notes->queries, sql);
+	if (pStmt != NULL) {
+		// Ctrl-C interrupts the statement, which undoes the whole delete
+		sqlite3_progress_handler(notes->db, DELETE_PROGRESS_OPS, local_cancel_progress, notes);
+		query_bind_text(pStmt, 1, arg, -1);
+		if (query_step(pStmt) == QUERY_OK)
+			removed = sqlite3_changes(notes->db);
+		query_done(pStmt);
+		sqlite3_progress_handler(notes->db, 0, NULL, NULL);
+	}
+	if (removed < 0 || query_cache_exec(notes->queries, "COMMIT") != QUERY_OK) {
+		query_cache_exec(notes->queries, "ROLLBACK");
+		return -1;
+	}
+	if (removed > 0) {
+		notes->maintenancePending = true;
+		local_vocab_stale(notes);
+	}
+	return removed;
+}
+
+static int64_t local_count_matches(Notes* notes, const char* expr) {
+	sqlite3_stmt* pStmt = query_cache_get(notes->queries, COUNT_MATCH_FORMAT);
+	if (pStmt == NULL)
+		return 0;
+	query_bind_text(pStmt, 1, expr, -1);
+	int64_t count = query_step(pStmt) == QUERY_ROW ? sqlite3_column_int64(pStmt, 0) : 0;
+	query_done(pStmt);
+	return count;
+}
+
+/* Asks before a search deletes anything, false if the answer is not yes */
+static bool local_confirm_delete(Notes* notes, InputState* state, const char* query, int64_t count) {
+	char question[512];
+	snprintf(question, sizeof(question),
+		"Delete %lld note%s matching \"%.200s\"? Type yes to confirm...",
+		(long long)count, count == 1 ? "" : "s", query);
+	ui_clear_and_print(state->ui, question);
+	text_input_clear(state->command);
+	ui_print_command_prompt(state->ui, state->command, ">\0", " \0");
+	display_refresh();
+	while (!*notes->prgSig) {
+		if (text_input_read(state, DKEY_RETURN))
+			return streqi(text_input_get_buffer(state->command), "yes");
+		display_refresh();
+	}
+	return false;
+}
+
+void notes_delete(Notes* notes, InputState* state, const char* spec) {
+	if (local_read_only(notes, state))
+		return;
+	char* arg;
+	const char* sql = DELETE_IDS_FORMAT;
+	if (!local_parse_id_ranges(spec, &arg)) {
+		sql = DELETE_MATCH_FORMAT;
+		if (!search_compile(spec, &arg)) {
+			ui_clear_and_print(state->ui, "Could not locate any notes to delete");
+			return;
+		}
+		int64_t count = local_count_matches(notes, arg);
+		if (count == 0 || !local_confirm_delete(notes, state, spec, count)) {
+			ui_clear_and_print(state->ui, count == 0
+				? "Could not locate any notes to delete" : "Nothing was deleted");
+			free(arg);
+			return;
+		}
+	}
+	ui_clear_and_print(state->ui, "Deleting...");
+	display_refresh();
+	double start = local_now();
+	int64_t removed = local_delete_batch(notes, sql, arg);
+	free(arg);
+	char status[128];
+	if (removed < 0) {
+		ui_clear_and_print(state->ui, *notes->prgSig
+			? "Delete cancelled, nothing was removed" : "Failed to delete, nothing was removed");
+	} else if (removed == 0)
 		ui_clear_and_print(state->ui, "Unable to locate the given note");
+	else if (removed == 1)
+		ui_clear_and_print(state->ui, "The note has been deleted");
+	else {
+		snprintf(status, sizeof(status), "Deleted %lld notes in %.2f s",
+			(long long)removed, local_now() - start);
+		ui_clear_and_print(state->ui, status);
+	}
 }
 
 void notes_search(Notes* notes, InputState* state, const char* term) {
-	sqlite3_stmt* pStmt = NULL;
-	int err = sqlite3_prepare_v2(notes->db, SAERCH_FORMAT, -1, &pStmt, NULL);
-	if (!err) {
-		sqlite3_bind_text(pStmt, 1, term, (int)strlen(term), NULL);
-		sqlite3_bind_text(pStmt, 2, term, (int)strlen(term), NULL);
-		NotesQueryList* list = calloc(1, sizeof(*list));
-		list->current = &list->head;
-		while (sqlite3_step(pStmt) == SQLITE_ROW) {
-			list->count++;
-			list->current->id = sqlite3_column_int(pStmt, 0);
-			strclone((const char*)sqlite3_column_text(pStmt, 1), &list->current->title);
-			strclone((const char*)sqlite3_column_text(pStmt, 2), &list->current->body);
-			list->current->next = calloc(1, sizeof(*list->current->next));
-			list->current = list->current->next;
-			memset(list->current, 0, sizeof(*list->current));
+	char* expr;
+	if (!search_compile(term, &expr)) {
+		ui_clear_and_print(state->ui, "Could not locate any matches");
+		return;
+	}
+	local_pager_begin(notes, state, NOTES_PAGER_SEARCH, expr);
+	free(expr);
+	local_pager_fetch(notes, NOTES_WINDOW_SEARCH, NULL);
+}
+
+void notes_grep(Notes* notes, InputState* state, const char* text) {
+	if (text[0] == '\0') {
+		ui_clear_and_print(state->ui, "Could not locate any matches");
+		return;
+	}
+	// The text is one FTS5 string, so it is a single phrase of trigrams
+	bool indexed = notes->trigramIndex && utf8len(text) >= GREP_MIN_INDEXED;
+	char* term = NULL;
+	if (indexed) {
+		size_t len = strlen(text);
+		term = malloc(len * 2 + 3);
+		size_t at = 0;
+		term[at++] = '"';
+		for (size_t i = 0; i < len; ++i) {
+			if (text[i] == '"')
+				term[at++] = '"';
+			term[at++] = text[i];
 		}
-		sqlite3_finalize(pStmt);
-		list->current = &list->head;
-		if (list->count == 0)
-			ui_clear_and_print(state->ui, "Could not locate any matches");
-		else if (list->count == 1) {
-			char output[4096];
-			snprintf(output, sizeof(output), "ID:    %d\nTitle: %s\n%s",
-				list->head.id, list->head.title, list->head.body);
-			ui_clear_and_print(state->ui, output);
+		term[at++] = '"';
+		term[at] = '\0';
+	}
+	local_pager_begin(notes, state, indexed ? NOTES_PAGER_GREP : NOTES_PAGER_SCAN,
+		indexed ? term : text);
+	free(term);
+	local_pager_fetch(notes, NOTES_WINDOW_SEARCH, NULL);
+}
+
+void notes_grep_index(Notes* notes, InputState* state, bool build) {
+	if (local_read_only(notes, state))
+		return;
+	char status[256];
+	if (build == notes->trigramIndex) {
+		ui_clear_and_print(state->ui, build ? "The substring index is already built"
+			: "There is no substring index to drop");
+		return;
+	}
+	ui_clear_and_print(state->ui, build ? "Building the substring index..." : "Dropping the substring index...");
+	display_refresh();
+	double start = local_now();
+	// Ctrl-C interrupts the build, which leaves the database as it was
+	int err = query_exec(notes->db, "BEGIN;");
+	if (!err) {
+		sqlite3_progress_handler(notes->db, TRIGRAM_PROGRESS_OPS, local_cancel_progress, notes);
+		err = query_exec(notes->db, build ? CREATE_TRIGRAM : DROP_TRIGRAM);
+		sqlite3_progress_handler(notes->db, 0, NULL, NULL);
+	}
+	if (!err)
+		err = query_exec(notes->db, "COMMIT;");
+	if (err) {
+		query_exec(notes->db, "ROLLBACK;");
+		ui_clear_and_print(state->ui, *notes->prgSig ? "Cancelled, the substring index was not changed"
+			: "Failed to change the substring index");
+		return;
+	}
+	notes->trigramIndex = build;
+	snprintf(status, sizeof(status), build
+		? "Built the substring index in %.1f s, grep now uses it"
+		: "Dropped the substring index in %.1f s, grep now reads every note", local_now() - start);
+	ui_clear_and_print(state->ui, status);
+}
+
+static void local_search_live_show(Notes* notes, InputState* state, const char* text) {
+	// The word being typed is searched as a prefix once it is long enough
+	// to be served by the prefix indexes
+	char* expr = NULL;
+	size_t len = strlen(text);
+	size_t wordLen = 0;
+	while (wordLen < len && !isspace((unsigned char)text[len - wordLen - 1]))
+		wordLen++;
+	if (wordLen >= LIVE_MIN_PREFIX && text[len - 1] != '*' && text[len - 1] != '"') {
+		char* prefixed = malloc(len + 2);
+		snprintf(prefixed, len + 2, "%s*", text);
+		search_compile(prefixed, &expr);
+		free(prefixed);
+	} else
+		search_compile(text, &expr);
+	if (expr == NULL) {
+		ui_clear_and_print(state->ui, "Start typing to search, press tab to complete a word, return to finish...");
+		ui_print_command_prompt(state->ui, state->command, ">\0", " \0");
+		return;
+	}
+	local_pager_begin(notes, state, NOTES_PAGER_SEARCH, expr);
+	free(expr);
+	local_pager_fetch(notes, NOTES_WINDOW_LIVE, text);
+}
+
+/* Completions for the last word of the live search, tab cycles through them */
+typedef struct {
+	char* terms[VOCAB_MAX_COMPLETIONS];
+	int32_t count;
+	int32_t next;
+	int32_t start;
+	char* text;		/* The search text as the last completion left it */
+} NotesCompletion;
+
+static void local_completion_clear(NotesCompletion* comp) {
+	for (int32_t i = 0; i < comp->count; ++i)
+		free(comp->terms[i]);
+	free(comp->text);
+	memset(comp, 0, sizeof(*comp));
+}
+
+static void local_search_complete(Notes* notes, InputState* state, NotesCompletion* comp) {
+	const char* text = text_input_get_buffer(state->command);
+	// Pressing tab again without typing moves on to the next completion
+	if (comp->text == NULL || strcmp(text, comp->text) != 0) {
+		local_completion_clear(comp);
+		if (notes->vocab == NULL)
+			return;
+		const char* terms[VOCAB_MAX_COMPLETIONS];
+		comp->count = vocab_complete(notes->vocab, text, &comp->start, terms);
+		for (int32_t i = 0; i < comp->count; ++i)
+			strclone(terms[i], &comp->terms[i]);
+		if (comp->count == 0)
+			return;
+	}
+	const char* term = comp->terms[comp->next];
+	comp->next = (comp->next + 1) % comp->count;
+	size_t len = (size_t)comp->start + strlen(term) + 1;
+	char* completed = malloc(len);
+	snprintf(completed, len, "%.*s%s", (int)comp->start, text, term);
+	text_input_set(state->command, completed);
+	strcloneclr(completed, &comp->text);
+	free(completed);
+	ui_print_command_prompt(state->ui, state->command, ">\0", " \0");
+}
+
+void notes_search_live(Notes* notes, InputState* state) {
+	ui_clear_and_print(state->ui, "Start typing to search, press tab to complete a word, return to finish...");
+	local_vocab_refresh(notes);
+	NotesCompletion comp = { .count = 0 };
+	text_input_clear(state->command);
+	ui_print_command_prompt(state->ui, state->command, ">\0", " \0");
+	display_set_input_delay(1);
+	char* shown = NULL;
+	strclone("", &shown);
+	double changed = 0.0;
+	bool pending = false;
+	while (!*notes->prgSig) {
+		bool entered = text_input_read(state, DKEY_RETURN);
+		local_poll(notes, state);
+		local_vocab_poll(notes);
+		if (state->key == DKEY_TAB)
+			local_search_complete(notes, state, &comp);
+		if (entered) {
+			if (text_input_get_len(state->command) > 0) {
+				notes_search(notes, state, text_input_get_buffer(state->command));
+				break;
+			}
 		} else {
-			// TODO:  Pick an option
-			char buff[512];
-			int w, h;
-			display_get_rows_cols(&h, &w);
-			assert(sizeof(buff) >= w);
-			int idx = list->count - 1;
-			ui_clear_and_print(state->ui, "Multiple entries found, pick an id...\n");
-			while (list->current != NULL && list->current->id > 0) {
-				local_print_listing(buff, sizeof(buff), list->current, w, state);
-				list->current = list->current->next;
+			const char* text = text_input_get_buffer(state->command);
+			if (strcmp(text, shown) != 0) {
+				strcloneclr(text, &shown);
+				changed = local_now();
+				pending = true;
+			} else if (pending && local_now() - changed >= LIVE_DEBOUNCE) {
+				pending = false;
+				local_search_live_show(notes, state, text);
 			}
-			text_input_clear(state->command);
-			ui_print_command_prompt(state->ui, state->command, ">\0", " \0");
 		}
-		local_query_list_free(list);
-	} else
-		ui_clear_and_print(state->ui, "Failed to query the database");
+		display_refresh();
+	}
+	display_set_input_delay(DISPLAY_INPUT_DELAY);
+	notes->pager->inputDelay = DISPLAY_INPUT_DELAY;
+	local_completion_clear(&comp);
+	free(shown);
 }
 
 void notes_create(Notes* notes, InputState* state) {
+	if (local_read_only(notes, state))
+		return;
 	ui_clear_and_print(state->ui, "Write a title for your note...");
 	text_input_clear(state->command);
 	ui_print_command_prompt(state->ui, state->command, ">\0", " \0");
@@ -234,14 +1291,24 @@ void notes_create(Notes* notes, InputState* state) {
 			ui_print_command_prompt(state->ui, state->command, ">\0", " \0");
 			while (!*notes->prgSig) {
 				if (text_input_read(state, DKEY_RETURN) && text_input_get_len(state->command) > 0) {
-					int err = wite_note(notes, title, text_input_get_buffer(state->command));
-					if (err) {
-						if (err == -1)
+					int64_t id;
+					char duplicate[128];
+					switch (wite_note(notes, title, text_input_get_buffer(state->command), &id)) {
+						case NOTES_WRITE_OK:
+							ui_clear_and_print(state->ui, "Note created!");
+							break;
+						case NOTES_WRITE_DUPLICATE:
+							snprintf(duplicate, sizeof(duplicate),
+								"This note already exists as note %lld", (long long)id);
+							ui_clear_and_print(state->ui, duplicate);
+							break;
+						case NOTES_WRITE_NO_FILE:
 							ui_clear_and_print(state->ui, "Could not locate the file to import... please try again");
-						else
+							break;
+						default:
 							ui_clear_and_print(state->ui, "There was an issue creating your note... please try again");
-					} else
-						ui_clear_and_print(state->ui, "Note created!");
+							break;
+					}
 					break;
 				}
 			}
@@ -257,47 +1324,634 @@ void notes_edit(Notes* notes, InputState* state, int id) {
 }
 
 void notes_list(Notes* notes, InputState* state) {
-	sqlite3_stmt* pStmt = NULL;
-	int err = sqlite3_prepare_v2(notes->db, LIST_FORMAT, -1, &pStmt, NULL);
-	if (!err) {
-		char buff[512];
-		int w, h;
-		display_get_rows_cols(&h, &w);
-		assert(sizeof(buff) >= w);
-		while (sqlite3_step(pStmt) == SQLITE_ROW) {
-			NotesQueryNode q = { .id = 0, .title = NULL, .body = NULL, .next = NULL };
-			q.id = sqlite3_column_int(pStmt, 0);
-			strclone((const char*)sqlite3_column_text(pStmt, 1), &q.title);
-			strclone((const char*)sqlite3_column_text(pStmt, 2), &q.body);
-			local_print_listing(buff, sizeof(buff), &q, w, state);
-			local_notes_query_free(&q);
+	local_pager_begin(notes, state, NOTES_PAGER_LIST, NULL);
+	local_pager_fetch(notes, NOTES_WINDOW_LIST, NULL);
+}
+
+/* Runs one merge of about the given number of pages, false if it did nothing */
+static bool local_merge_step(Notes* notes, const char* sql, int32_t pages) {
+	sqlite3_stmt* pStmt = query_cache_get(notes->queries, sql);
+	if (pStmt == NULL)
+		return false;
+	query_bind_int(pStmt, 1, pages);
+	// FTS5 documents a change count below 2 as the merge having no work
+	int before = sqlite3_total_changes(notes->db);
+	int res = query_step(pStmt);
+	query_done(pStmt);
+	return res == QUERY_OK && sqlite3_total_changes(notes->db) - before >= 2;
+}
+
+static int32_t local_count_segments(Notes* notes) {
+	sqlite3_stmt* pStmt = query_cache_get(notes->queries, SEGMENTS_FORMAT);
+	if (pStmt == NULL)
+		return 0;
+	int32_t count = query_step(pStmt) == QUERY_ROW ? sqlite3_column_int(pStmt, 0) : 0;
+	query_done(pStmt);
+	return count;
+}
+
+/* Merges segments (of the substring index too once the search index has
+ * none left) until the budget runs out, then checkpoints once nothing is
+ * left to merge. Returns true while there may be more work */
+static bool local_maintain_step(Notes* notes, double budget) {
+	double start = local_now();
+	do {
+		if (!local_merge_step(notes, MERGE_FORMAT, MAINTAIN_PAGES)
+			&& !(notes->trigramIndex && local_merge_step(notes, MERGE_TRIGRAM, MAINTAIN_PAGES)))
+		{
+			sqlite3_wal_checkpoint_v2(notes->db, NULL,
+				SQLITE_CHECKPOINT_PASSIVE, NULL, NULL);
+			return false;
 		}
-		sqlite3_finalize(pStmt);
+	} while (local_now() - start < budget);
+	return true;
+}
+
+void notes_poll(Notes* notes, InputState* state) {
+	local_poll(notes, state);
+	local_vocab_poll(notes);
+	double now = local_now();
+	bool busy = notes->worker != NULL && db_worker_busy(notes->worker);
+	if (state->key != ERR || busy)
+		notes->idleSince = now;
+	else if (notes->maintenancePending && now - notes->idleSince >= MAINTAIN_IDLE)
+		notes->maintenancePending = local_maintain_step(notes, MAINTAIN_BUDGET);
+	// Input is checked more often while results are on their way or while
+	// idle maintenance still has steps to run
+	bool maintaining = notes->maintenancePending && now - notes->idleSince >= MAINTAIN_IDLE;
+	int delay = busy || maintaining ? POLL_INPUT_DELAY : DISPLAY_INPUT_DELAY;
+	if (delay != notes->pager->inputDelay) {
+		display_set_input_delay(delay);
+		notes->pager->inputDelay = delay;
 	}
 }
 
+static NotesImportRecord* local_import_record(NotesImportResult res, size_t bytes, size_t extra) {
+	NotesImportRecord* rec = malloc(sizeof(NotesImportRecord) + extra);
+	memset(rec, 0, sizeof(NotesImportRecord));
+	rec->res = res;
+	rec->bytes = bytes;
+	return rec;
+}
+
+/* Checks the text and finds the end of the title line */
+static NotesImportResult local_import_split(const char* data, size_t size, size_t* outTitleLen) {
+	Utf8Stream utf8 = { 0 };
+	if (!utf8stream_feed(&utf8, data, size) || !utf8stream_end(&utf8))
+		return NOTES_IMPORT_INVALID_TEXT;
+	const char* end = memchr(data, '\n', size);
+	if (end == NULL)
+		return NOTES_IMPORT_NO_TITLE;
+	*outTitleLen = (size_t)(end - data);
+	if (*outTitleLen + 1 == size)
+		return NOTES_IMPORT_NO_BODY;
+	return NOTES_IMPORT_OK;
+}
+
+static NotesImportResult local_import_result(NotesWriteResult write) {
+	if (write == NOTES_WRITE_DUPLICATE)
+		return NOTES_IMPORT_DUPLICATE;
+	else if (write != NOTES_WRITE_OK)
+		return NOTES_IMPORT_WRITE_FAILED;
+	return NOTES_IMPORT_OK;
+}
+
+/* Everything the writer does not need the database for happens here */
+static NotesImportRecord* local_import_prepare(const char* data, size_t size) {
+	size_t titleLen = 0;
+	NotesImportResult res = local_import_split(data, size, &titleLen);
+	if (res != NOTES_IMPORT_OK)
+		return local_import_record(res, size, 0);
+	const char* end = data + titleLen;
+	size_t bodyLen = size - titleLen - 1;
+	void* packed;
+	size_t packedLen = db_compress_body(end + 1, bodyLen, &packed);
+	size_t storedLen = packedLen > 0 ? packedLen : bodyLen;
+	NotesImportRecord* rec = local_import_record(NOTES_IMPORT_OK, size, titleLen + storedLen);
+	rec->titleLen = (int64_t)titleLen;
+	rec->storedLen = (int64_t)storedLen;
+	rec->size = (int64_t)bodyLen;
+	rec->hash = db_note_hash(data, titleLen, end + 1, bodyLen);
+	rec->packed = packedLen > 0;
+	memcpy(rec->data, data, titleLen);
+	memcpy(rec->data + titleLen, packedLen > 0 ? packed : end + 1, storedLen);
+	free(packed);
+	return rec;
+}
+
+static NotesImportResult local_import_store(Notes* notes,
+	const NotesImportRecord* rec, int64_t* outId)
+{
+	*outId = 0;
+	if (rec->res != NOTES_IMPORT_OK)
+		return rec->res;
+	return local_import_result(local_insert_note(notes, rec->data, rec->titleLen,
+		rec->data + rec->titleLen, rec->storedLen, rec->packed, rec->size, rec->hash, outId));
+}
+
+/* Writes straight from data (a mapped file for a single import), only the
+ * threaded directory import copies notes into records */
+static NotesImportResult local_import_note(Notes* notes, const char* data,
+	size_t size, int64_t* outId)
+{
+	size_t titleLen = 0;
+	*outId = 0;
+	NotesImportResult res = local_import_split(data, size, &titleLen);
+	if (res != NOTES_IMPORT_OK)
+		return res;
+	return local_import_result(local_write_note(notes, data, (int64_t)titleLen,
+		data + titleLen + 1, (int64_t)(size - titleLen - 1), outId));
+}
+
+static NotesImportResult local_import_file(Notes* notes, const char* file,
+	size_t* outBytes, int64_t* outId)
+{
+	FileView view;
+	*outBytes = 0;
+	*outId = 0;
+	if (!file_view_open(file, &view))
+		return NOTES_IMPORT_OPEN_FAILED;
+	*outBytes = view.size;
+	NotesImportResult res = local_import_note(notes, view.data, view.size, outId);
+	if (res == NOTES_IMPORT_OK) {
+		size_t titleLen = (size_t)((const char*)memchr(view.data, '\n', view.size) - view.data);
+		local_vocab_note_added(notes, view.data, titleLen,
+			view.data + titleLen + 1, view.size - titleLen - 1);
+	}
+	file_view_close(&view);
+	return res;
+}
+
 void notes_import(Notes* notes, InputState* state, const char* file) {
-	char* txt;
-	if (local_read_text_file(file, &txt) == 0) {
-		ui_clear_and_print(state->ui, "Failed to open the file to import");
-	} else {
-		int end = stridxof(txt, "\n", 0);
-		if (end == -1)
+	if (local_read_only(notes, state))
+		return;
+	size_t bytes;
+	int64_t id;
+	char duplicate[128];
+	switch (local_import_file(notes, file, &bytes, &id)) {
+		case NOTES_IMPORT_OK:
+			ui_clear_and_print(state->ui, "Note imported!");
+			break;
+		case NOTES_IMPORT_DUPLICATE:
+			snprintf(duplicate, sizeof(duplicate),
+				"This file was already imported as note %lld", (long long)id);
+			ui_clear_and_print(state->ui, duplicate);
+			break;
+		case NOTES_IMPORT_OPEN_FAILED:
+			ui_clear_and_print(state->ui, "Failed to open the file to import");
+			break;
+		case NOTES_IMPORT_NO_TITLE:
 			ui_clear_and_print(state->ui, "Invalid file format, expected the first line to be title, and the rest to be body");
+			break;
+		case NOTES_IMPORT_NO_BODY:
+			ui_clear_and_print(state->ui, "Found a title, but did not find a body for the note");
+			break;
+		case NOTES_IMPORT_INVALID_TEXT:
+			ui_clear_and_print(state->ui, "The file is not valid UTF-8 text");
+			break;
+		case NOTES_IMPORT_WRITE_FAILED:
+			ui_clear_and_print(state->ui, "Failed to create note, check permissions and try again...");
+			break;
+	}
+}
+
+/* Whichever stage the others keep waiting on is what limits the import */
+static const char* local_import_bound(const NotesImportStages* stages) {
+	double write = (double)atomic_load(&stages->write);
+	double writerWait = (double)atomic_load(&stages->writerWait);
+	if (write >= writerWait)
+		return "SQLite bound";
+	double read = (double)atomic_load(&stages->read);
+	double prepare = (double)atomic_load(&stages->prepare);
+	return read >= prepare ? "I/O bound" : "CPU bound";
+}
+
+static void local_print_import_progress(NotesImport* imp, const char* status) {
+	char output[768];
+	double elapsed = local_now() - imp->start;
+	if (elapsed <= 0.0)
+		elapsed = 0.000001;
+	int len = snprintf(output, sizeof(output),
+		"%s\nImported %lld %s (%.2f MB), skipped %lld, %lld already imported\n%.1f %s/sec, %.2f MB/sec",
+		status, (long long)imp->items, imp->what, (double)imp->bytes / (1024.0 * 1024.0),
+		(long long)imp->skipped, (long long)imp->duplicates, (double)imp->items / elapsed,
+		imp->what, ((double)imp->bytes / (1024.0 * 1024.0)) / elapsed);
+	const NotesImportStages* stages = imp->stages;
+	if (stages != NULL && len > 0 && len < (int)sizeof(output)) {
+		// Reader times are summed over every reader thread
+		snprintf(output + len, sizeof(output) - (size_t)len,
+			"\n%d readers: read %.2fs, prepare %.2fs, idle %.2fs, blocked on writer %.2fs"
+			"\nWriter: insert %.2fs, waiting for readers %.2fs (%s)",
+			stages->readers, (double)atomic_load(&stages->read) / 1000000.0,
+			(double)atomic_load(&stages->prepare) / 1000000.0,
+			(double)atomic_load(&stages->readerWait) / 1000000.0,
+			(double)atomic_load(&stages->readerBlocked) / 1000000.0,
+			(double)atomic_load(&stages->write) / 1000000.0,
+			(double)atomic_load(&stages->writerWait) / 1000000.0,
+			local_import_bound(stages));
+	}
+	ui_clear_and_print(imp->state->ui, output);
+	display_refresh();
+}
+
+static void local_import_begin(NotesImport* imp) {
+	imp->start = local_now();
+	ui_clear_and_print(imp->state->ui, "Importing...");
+	display_refresh();
+	db_profile_apply(imp->notes->db, db_profile_find(DB_PROFILE_BULK_LOAD), false);
+}
+
+/* Records one imported note, committing the batch once it is full */
+static bool local_import_counted(NotesImport* imp, NotesImportResult res, size_t bytes) {
+	Notes* notes = imp->notes;
+	if (res == NOTES_IMPORT_OK) {
+		imp->batchItems++;
+		imp->batchBytes += (int64_t)bytes;
+	} else if (res == NOTES_IMPORT_DUPLICATE)
+		imp->duplicates++;
+	else
+		imp->skipped++;
+	if (imp->batchItems >= notes->importBatchSize) {
+		if (query_cache_exec(notes->queries, "COMMIT") != QUERY_OK)
+			return false;
+		imp->items += imp->batchItems;
+		imp->bytes += imp->batchBytes;
+		imp->batchItems = 0;
+		imp->batchBytes = 0;
+		local_print_import_progress(imp, "Importing...");
+	}
+	return true;
+}
+
+static inline bool local_import_in_batch(NotesImport* imp) {
+	Notes* notes = imp->notes;
+	if (*notes->prgSig)
+		return false;
+	return !sqlite3_get_autocommit(notes->db)
+		|| query_cache_exec(notes->queries, "BEGIN") == QUERY_OK;
+}
+
+static void local_import_finish(NotesImport* imp, bool completed, const char* openFailed) {
+	Notes* notes = imp->notes;
+	if (!sqlite3_get_autocommit(notes->db)) {
+		// Only whole batches are kept when the import is cancelled
+		if (completed && query_cache_exec(notes->queries, "COMMIT") == QUERY_OK) {
+			imp->items += imp->batchItems;
+			imp->bytes += imp->batchBytes;
+		} else
+			query_cache_exec(notes->queries, "ROLLBACK");
+	}
+	// The bulk profile never checkpoints, so the WAL is folded back in here
+	db_profile_apply(notes->db, notes->profile, false);
+	query_cache_exec(notes->queries, "PRAGMA wal_checkpoint(PASSIVE)");
+	if (imp->items > 0)
+		local_vocab_stale(notes);
+	if (completed)
+		local_print_import_progress(imp, "Import complete!");
+	else if (*notes->prgSig)
+		local_print_import_progress(imp, "Import cancelled, the last partial batch was discarded");
+	else if (imp->items == 0 && imp->batchItems == 0 && imp->skipped == 0 && imp->duplicates == 0)
+		ui_clear_and_print(imp->state->ui, openFailed);
+	else
+		local_print_import_progress(imp, "Import failed, the last partial batch was discarded");
+}
+
+static inline void local_stage_add(atomic_llong* counter, double since) {
+	atomic_fetch_add(counter, (long long)((local_now() - since) * 1000000.0));
+}
+
+static bool local_import_walked(void* state, const char* path) {
+	NotesImportPipeline* pipe = state;
+	char* copy;
+	strclone(path, &copy);
+	if (queue_push(pipe->paths, copy))
+		return true;
+	free(copy);
+	return false;
+}
+
+static int local_import_walker(void* arg) {
+	NotesImportPipeline* pipe = arg;
+	if (!file_walk_dir(pipe->root, local_import_walked, pipe))
+		atomic_store(&pipe->walkFailed, true);
+	queue_close(pipe->paths);
+	return 0;
+}
+
+static int local_import_reader(void* arg) {
+	NotesImportPipeline* pipe = arg;
+	NotesImportStages* stages = &pipe->stages;
+	char* buffer = NULL;
+	size_t capacity = 0;
+	void* item;
+	for (;;) {
+		double mark = local_now();
+		if (queue_pop(pipe->paths, &item, QUEUE_WAIT_FOREVER) != QUEUE_ITEM)
+			break;
+		local_stage_add(&stages->readerWait, mark);
+		mark = local_now();
+		size_t size;
+		bool read = file_read_all(item, &buffer, &capacity, &size);
+		free(item);
+		local_stage_add(&stages->read, mark);
+		mark = local_now();
+		NotesImportRecord* rec = read ? local_import_prepare(buffer, size)
+			: local_import_record(NOTES_IMPORT_OPEN_FAILED, 0, 0);
+		local_stage_add(&stages->prepare, mark);
+		mark = local_now();
+		if (!queue_push(pipe->records, rec)) {
+			free(rec);
+			break;
+		}
+		local_stage_add(&stages->readerBlocked, mark);
+	}
+	free(buffer);
+	// The last reader out tells the writer nothing more is coming
+	if (atomic_fetch_sub(&pipe->readers, 1) == 1)
+		queue_close(pipe->records);
+	return 0;
+}
+
+/* Stops the walker and readers early, then frees anything left queued */
+static void local_import_drain(NotesImportPipeline* pipe) {
+	void* item;
+	queue_close(pipe->paths);
+	queue_close(pipe->records);
+	while (queue_pop(pipe->paths, &item, 0) == QUEUE_ITEM)
+		free(item);
+	while (queue_pop(pipe->records, &item, 0) == QUEUE_ITEM)
+		free(item);
+}
+
+static bool local_import_write(NotesImport* imp, Queue* records) {
+	NotesImportStages* stages = imp->stages;
+	Notes* notes = imp->notes;
+	for (;;) {
+		if (*notes->prgSig)
+			return false;
+		double mark = local_now();
+		void* item;
+		QueueResult res = queue_pop(records, &item, IMPORT_STATUS_MS);
+		local_stage_add(&stages->writerWait, mark);
+		if (res == QUEUE_CLOSED)
+			return true;
+		else if (res == QUEUE_TIMEOUT) {
+			local_print_import_progress(imp, "Importing...");
+			continue;
+		}
+		mark = local_now();
+		NotesImportRecord* rec = item;
+		bool ok = local_import_in_batch(imp);
+		if (ok) {
+			int64_t id;
+			ok = local_import_counted(imp, local_import_store(notes, rec, &id), rec->bytes);
+		}
+		free(rec);
+		local_stage_add(&stages->write, mark);
+		if (!ok)
+			return false;
+	}
+}
+
+void notes_import_dir(Notes* notes, InputState* state, const char* path) {
+	if (local_read_only(notes, state))
+		return;
+	NotesImportPipeline pipe = {
+		.root = path,
+		.paths = queue_new(IMPORT_QUEUE_SIZE),
+		.records = queue_new(IMPORT_QUEUE_SIZE)
+	};
+	NotesImport imp = {
+		.notes = notes,
+		.state = state,
+		.what = "files",
+		.stages = &pipe.stages
+	};
+	pipe.stages.readers = notes->importThreads;
+	local_import_begin(&imp);
+	thrd_t walker;
+	thrd_t readers[NOTES_IMPORT_MAX_THREADS];
+	bool walking = thrd_create(&walker, local_import_walker, &pipe) == thrd_success;
+	int started = 0;
+	if (walking) {
+		atomic_store(&pipe.readers, notes->importThreads);
+		for (; started < notes->importThreads; ++started) {
+			if (thrd_create(&readers[started], local_import_reader, &pipe) != thrd_success)
+				break;
+		}
+		// Readers that failed to start still have to count themselves out
+		for (int i = started; i < notes->importThreads; ++i) {
+			if (atomic_fetch_sub(&pipe.readers, 1) == 1)
+				queue_close(pipe.records);
+		}
+	}
+	bool completed = walking && started > 0 && local_import_write(&imp, pipe.records);
+	local_import_drain(&pipe);
+	if (walking)
+		thrd_join(walker, NULL);
+	for (int i = 0; i < started; ++i)
+		thrd_join(readers[i], NULL);
+	local_import_drain(&pipe);
+	if (atomic_load(&pipe.walkFailed))
+		completed = false;
+	local_import_finish(&imp, completed, "Failed to open the directory to import");
+	queue_free(pipe.records);
+	queue_free(pipe.paths);
+}
+
+static NotesImportResult local_import_json(Notes* notes, const char* line,
+	size_t size, int64_t* outId)
+{
+	sqlite3_stmt* pStmt = query_cache_get(notes->queries, JSON_NOTE_FORMAT);
+	if (pStmt == NULL)
+		return NOTES_IMPORT_WRITE_FAILED;
+	NotesImportResult res = NOTES_IMPORT_NO_TITLE;
+	query_bind_text(pStmt, 1, line, (int64_t)size);
+	if (query_step(pStmt) == QUERY_ROW && sqlite3_column_type(pStmt, 0) == SQLITE_TEXT) {
+		if (sqlite3_column_type(pStmt, 1) != SQLITE_TEXT || sqlite3_column_bytes(pStmt, 1) == 0)
+			res = NOTES_IMPORT_NO_BODY;
 		else {
-			const char* title = txt;
-			const char* body = txt + end + 1;
-			txt[end] = '\0';
-			if (strlen(body) == 0)
-				ui_clear_and_print(state->ui, "Found a title, but did not find a body for the note");
-			else {
-				int err = wite_note(notes, title, body);
-				if (err)
-					ui_clear_and_print(state->ui, "Failed to create note, check permissions and try again...");
-				else
-					ui_clear_and_print(state->ui, "Note imported!");
-			}
+			res = local_import_result(local_write_note(notes,
+				(const char*)sqlite3_column_text(pStmt, 0), sqlite3_column_bytes(pStmt, 0),
+				(const char*)sqlite3_column_text(pStmt, 1), sqlite3_column_bytes(pStmt, 1), outId));
 		}
-		free(txt);
 	}
-}
\ No newline at end of file
+	query_done(pStmt);
+	return res;
+}
+
+/* Hands the buffered note (up to len) to the importer and starts the next one */
+static bool local_archive_emit(NotesArchive* arc, size_t len) {
+	bool ok = true;
+	bool blank = true;
+	for (size_t i = 0; i < len && blank; ++i)
+		blank = isspace((unsigned char)arc->note[i]);
+	if (arc->skip || !utf8stream_end(&arc->utf8))
+		ok = local_import_counted(arc->import, NOTES_IMPORT_NO_TITLE, 0);
+	else if (!blank) {
+		int64_t id;
+		NotesImportResult res = arc->jsonl
+			? local_import_json(arc->import->notes, arc->note, len, &id)
+			: local_import_note(arc->import->notes, arc->note, len, &id);
+		ok = local_import_counted(arc->import, res, len);
+	}
+	arc->len = 0;
+	arc->skip = false;
+	memset(&arc->utf8, 0, sizeof(arc->utf8));
+	return ok;
+}
+
+/* Takes the next piece of a line, which is validated as it arrives */
+static void local_archive_take(NotesArchive* arc, const char* data, size_t len) {
+	if (arc->lineLen < sizeof(arc->lineHead)) {
+		size_t head = sizeof(arc->lineHead) - arc->lineLen;
+		memcpy(arc->lineHead + arc->lineLen, data, len < head ? len : head);
+	}
+	arc->lineLen += len;
+	if (arc->skip)
+		return;
+	if (arc->len + len > ARCHIVE_MAX_NOTE || !utf8stream_feed(&arc->utf8, data, len)) {
+		arc->skip = true;
+		return;
+	}
+	if (arc->capacity - arc->len < len) {
+		size_t capacity = arc->capacity > 0 ? arc->capacity : 4096;
+		while (capacity - arc->len < len)
+			capacity *= 2;
+		arc->note = realloc(arc->note, capacity);
+		arc->capacity = capacity;
+	}
+	memcpy(arc->note + arc->len, data, len);
+	arc->len += len;
+}
+
+/* A whole line has been taken, a JSONL line or a bundle delimiter ends a note */
+static bool local_archive_line(NotesArchive* arc) {
+	bool ok = true;
+	size_t lineLen = arc->lineLen;
+	arc->lineLen = 0;
+	if (arc->jsonl)
+		ok = local_archive_emit(arc, arc->skip ? 0 : arc->len - 1);
+	else if ((lineLen == 3 && memcmp(arc->lineHead, ARCHIVE_DELIMITER "\n", 3) == 0)
+		|| (lineLen == 4 && memcmp(arc->lineHead, ARCHIVE_DELIMITER "\r\n", 4) == 0))
+	{
+		ok = local_archive_emit(arc, arc->skip ? 0 : arc->len - lineLen);
+	}
+	return ok;
+}
+
+static bool local_import_archive_file(NotesArchive* arc, FILE* fp) {
+	char* chunk = malloc(ARCHIVE_CHUNK_SIZE);
+	size_t read;
+	bool ok = true;
+	while (ok && (read = fread(chunk, 1, ARCHIVE_CHUNK_SIZE, fp)) > 0) {
+		const char* at = chunk;
+		const char* end = chunk + read;
+		while (ok && at < end) {
+			ok = local_import_in_batch(arc->import);
+			const char* nl = memchr(at, '\n', (size_t)(end - at));
+			const char* next = nl != NULL ? nl + 1 : end;
+			local_archive_take(arc, at, (size_t)(next - at));
+			if (ok && nl != NULL)
+				ok = local_archive_line(arc);
+			at = next;
+		}
+	}
+	if (ok && ferror(fp))
+		ok = false;
+	// The last note does not need a newline or delimiter after it
+	if (ok && (arc->len > 0 || arc->skip) && local_import_in_batch(arc->import))
+		ok = local_archive_emit(arc, arc->len);
+	free(chunk);
+	return ok;
+}
+
+void notes_import_archive(Notes* notes, InputState* state, const char* file) {
+	if (local_read_only(notes, state))
+		return;
+	NotesImport imp = {
+		.notes = notes,
+		.state = state,
+		.what = "notes"
+	};
+	NotesArchive arc = {
+		.import = &imp,
+		.jsonl = strcmpend(file, ".jsonl") == 0
+	};
+	FILE* fp = fopen(file, "rb");
+	if (fp == NULL) {
+		ui_clear_and_print(state->ui, "Failed to open the archive to import");
+		return;
+	}
+	// Chunks are read straight into our own buffer
+	setvbuf(fp, NULL, _IONBF, 0);
+	local_import_begin(&imp);
+	bool completed = local_import_archive_file(&arc, fp);
+	fclose(fp);
+	free(arc.note);
+	local_import_finish(&imp, completed, "Failed to read the archive to import");
+}
+
+void notes_compact(Notes* notes, InputState* state) {
+	if (local_read_only(notes, state))
+		return;
+	char status[256];
+	double start = local_now();
+	int32_t total = local_count_segments(notes);
+	int32_t left = total;
+	bool cancelled = false;
+	// Merging everything as one level a few pages at a time reaches the same
+	// single segment as 'optimize' but can report progress and be cancelled
+	while (!(cancelled = *notes->prgSig) && local_merge_step(notes, MERGE_FORMAT, -COMPACT_PAGES)) {
+		left = local_count_segments(notes);
+		snprintf(status, sizeof(status),
+			"Compacting the search index, %d of %d segments left (%.1f s)...",
+			left, total, local_now() - start);
+		ui_clear_and_print(state->ui, status);
+		display_refresh();
+	}
+	if (!cancelled) {
+		query_cache_exec(notes->queries, OPTIMIZE_FORMAT);
+		if (notes->trigramIndex)
+			query_cache_exec(notes->queries, OPTIMIZE_TRIGRAM);
+		sqlite3_wal_checkpoint_v2(notes->db, NULL, SQLITE_CHECKPOINT_TRUNCATE, NULL, NULL);
+		notes->maintenancePending = false;
+		left = local_count_segments(notes);
+	}
+	snprintf(status, sizeof(status), "%s the search index from %d to %d segments in %.1f s",
+		cancelled ? "Cancelled compacting" : "Compacted", total, left, local_now() - start);
+	ui_clear_and_print(state->ui, status);
+}
+
+void notes_dedupe(Notes* notes, InputState* state) {
+	if (local_read_only(notes, state))
+		return;
+	char status[256];
+	ui_clear_and_print(state->ui, "Removing duplicate notes...");
+	display_refresh();
+	double start = local_now();
+	// Hash whatever can be hashed first, so a copy of a note that was never
+	// hashed keeps one survivor, then drop the rows that are left over
+	int err = query_cache_exec(notes->queries, "BEGIN");
+	if (!err)
+		err = query_exec(notes->db, HASH_NOTES);
+	int64_t removed = 0;
+	if (!err) {
+		err = query_cache_exec(notes->queries, DEDUPE_FORMAT);
+		removed = sqlite3_changes(notes->db);
+	}
+	if (!err)
+		err = query_cache_exec(notes->queries, "COMMIT");
+	if (err) {
+		query_cache_exec(notes->queries, "ROLLBACK");
+		ui_clear_and_print(state->ui, "Failed to remove duplicate notes, nothing was changed");
+		return;
+	}
+	if (removed > 0) {
+		notes->maintenancePending = true;
+		local_vocab_stale(notes);
+	}
+	snprintf(status, sizeof(status), "Removed %lld duplicate note%s in %.1f s",
+		(long long)removed, removed == 1 ? "" : "s", local_now() - start);
+	ui_clear_and_print(state->ui, status);
+}
@@ -7,22 +7,63 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <db/query.h>
+#include <db/profile.h>
+#include <db/snapshot.h>
+#include <db/worker.h>
 #include <ext/sqlite3.h>
 #include <display/input.h>
+#include <notes/vocab.h>
+
+#define NOTES_IMPORT_BATCH_SIZE		1000
+#define NOTES_IMPORT_THREADS		4
+#define NOTES_IMPORT_MAX_THREADS	32
+#define NOTES_TITLE_WEIGHT			10.0
+#define NOTES_BODY_WEIGHT			1.0
+#define NOTES_DB_PATH				"./nc.db"
+
+typedef struct NotesPager NotesPager;
 
 typedef struct {
 	sqlite3* db;
+	QueryCache* queries;
+	DbWorker* worker;
+	DbSnapshot* snapshot;
+	const DbProfile* profile;
+	NotesPager* pager;
+	NotesVocab* vocab;
+	NotesVocabLoader* vocabLoader;
 	volatile const bool* prgSig;
+	int32_t importBatchSize;
+	int32_t importThreads;
+	double titleWeight;
+	double bodyWeight;
+	double idleSince;
+	bool maintenancePending;
+	bool vocabStale;
+	bool trigramIndex;
 } Notes;
 
-Notes* notes_new(volatile const bool* prgSig);
+Notes* notes_new(volatile const bool* prgSig, const DbProfile* profile);
 void notes_free(Notes* notes);
+bool notes_snapshot(Notes* notes, InputState* state);
 void notes_select(Notes* notes, InputState* state, int32_t id);
-void notes_delete(Notes* notes, InputState* state, int32_t id);
+void notes_delete(Notes* notes, InputState* state, const char* spec);
 void notes_search(Notes* notes, InputState* state, const char* term);
+void notes_search_live(Notes* notes, InputState* state);
+void notes_grep(Notes* notes, InputState* state, const char* text);
+void notes_grep_index(Notes* notes, InputState* state, bool build);
 void notes_create(Notes* notes, InputState* state);
 void notes_edit(Notes* notes, InputState* state, int id);
 void notes_list(Notes* notes, InputState* state);
+void notes_poll(Notes* notes, InputState* state);
+void notes_run_job(Notes* notes, DbJob* job);
+void notes_compact(Notes* notes, InputState* state);
+void notes_dedupe(Notes* notes, InputState* state);
+void notes_export(Notes* notes, InputState* state, const char* args);
+void notes_stats(Notes* notes, InputState* state);
 void notes_import(Notes* notes, InputState* state, const char* file);
+void notes_import_dir(Notes* notes, InputState* state, const char* path);
+void notes_import_archive(Notes* notes, InputState* state, const char* file);
 
 #endif
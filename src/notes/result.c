@@ -0,0 +1,58 @@
+#include "result.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NOTES_RESULT_START_ROWS	64
+#define NOTES_RESULT_START_TEXT	4096
+
+void notes_result_init(NotesResult* result) {
+	memset(result, 0, sizeof(*result));
+}
+
+void notes_result_free(NotesResult* result) {
+	free(result->rows);
+	free(result->text);
+	notes_result_init(result);
+}
+
+void notes_result_clear(NotesResult* result) {
+	result->count = 0;
+	result->textLen = 0;
+}
+
+static inline size_t local_push_text(NotesResult* result, const char* text, size_t len) {
+	if (result->textLen + len + 1 > result->textCapacity) {
+		size_t capacity = result->textCapacity > 0
+			? result->textCapacity : NOTES_RESULT_START_TEXT;
+		while (result->textLen + len + 1 > capacity)
+			capacity *= 2;
+		result->text = realloc(result->text, capacity);
+		result->textCapacity = capacity;
+	}
+	size_t offset = result->textLen;
+	if (len > 0)
+		memcpy(result->text + offset, text, len);
+	result->text[offset + len] = '\0';
+	result->textLen += len + 1;
+	return offset;
+}
+
+void notes_result_add(NotesResult* result, sqlite3_stmt* stmt,
+	int rankCol, int firstField, int fieldCount)
+{
+	assert(fieldCount <= NOTES_RESULT_MAX_FIELDS);
+	if (result->count == result->capacity) {
+		result->capacity = result->capacity > 0
+			? result->capacity * 2 : NOTES_RESULT_START_ROWS;
+		result->rows = realloc(result->rows, result->capacity * sizeof(*result->rows));
+	}
+	NotesResultRow* row = &result->rows[result->count++];
+	row->id = sqlite3_column_int64(stmt, 0);
+	row->rank = rankCol >= 0 ? sqlite3_column_double(stmt, rankCol) : 0.0;
+	for (int i = 0; i < fieldCount; ++i) {
+		const char* text = (const char*)sqlite3_column_text(stmt, firstField + i);
+		size_t len = (size_t)sqlite3_column_bytes(stmt, firstField + i);
+		row->fields[i] = local_push_text(result, text, text != NULL ? len : 0);
+	}
+}
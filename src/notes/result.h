@@ -0,0 +1,53 @@
+#ifndef NOTECOMMANDER_RESULT_H
+#define NOTECOMMANDER_RESULT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ext/sqlite3.h>
+
+#define NOTES_RESULT_MAX_FIELDS	2
+
+typedef struct {
+	int64_t id;
+	double rank;
+	size_t fields[NOTES_RESULT_MAX_FIELDS];
+} NotesResultRow;
+
+/******************************************************************************\
+* A set of result rows kept in two growable arenas, one of fixed size rows and
+* one of packed NUL terminated text the rows point into by offset. Clearing or
+* freeing the set never walks the rows
+\******************************************************************************/
+typedef struct {
+	NotesResultRow* rows;
+	char* text;
+	int32_t count;
+	int32_t capacity;
+	size_t textLen;
+	size_t textCapacity;
+} NotesResult;
+
+void notes_result_init(NotesResult* result);
+void notes_result_free(NotesResult* result);
+
+/******************************************************************************\
+* Forget all rows while keeping the arenas for reuse
+\******************************************************************************/
+void notes_result_clear(NotesResult* result);
+
+/******************************************************************************\
+* Append the current row of the statement. Column 0 is the id, the rank is read
+* from rankCol unless it is negative, and fieldCount text columns are read
+* starting at firstField
+\******************************************************************************/
+void notes_result_add(NotesResult* result, sqlite3_stmt* stmt,
+	int rankCol, int firstField, int fieldCount);
+
+static inline const char* notes_result_text(const NotesResult* result,
+	int32_t row, int32_t field)
+{
+	return result->text + result->rows[row].fields[field];
+}
+
+#endif
@@ -0,0 +1,224 @@
+#include "search.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libc/string.h>
+
+#define SEARCH_MAX_DEPTH	32
+
+typedef struct {
+	char* str;
+	size_t len;
+	size_t capacity;
+} SearchOutput;
+
+typedef struct {
+	size_t start;
+	bool haveLeft;
+} SearchGroup;
+
+static void local_emit(SearchOutput* out, const char* str, size_t len) {
+	if (out->len + len + 1 > out->capacity) {
+		while (out->len + len + 1 > out->capacity)
+			out->capacity = out->capacity > 0 ? out->capacity * 2 : 64;
+		out->str = realloc(out->str, out->capacity);
+	}
+	memcpy(out->str + out->len, str, len);
+	out->len += len;
+	out->str[out->len] = '\0';
+}
+
+static inline void local_emit_str(SearchOutput* out, const char* str) {
+	local_emit(out, str, strlen(str));
+}
+
+static void local_emit_phrase(SearchOutput* out, const char* str, size_t len) {
+	local_emit(out, "\"", 1);
+	for (size_t i = 0; i < len; ++i) {
+		if (str[i] == '"')
+			local_emit(out, "\"\"", 2);
+		else
+			local_emit(out, str + i, 1);
+	}
+	local_emit(out, "\"", 1);
+}
+
+/* FTS5 only allows implicit AND between plain phrases, so it is always written */
+static inline void local_emit_op(SearchOutput* out, const char* op) {
+	local_emit_str(out, " ");
+	local_emit_str(out, op != NULL ? op : "AND");
+	local_emit_str(out, " ");
+}
+
+static inline bool local_is_break(char c) {
+	return c == '\0' || isspace((unsigned char)c) || c == '(' || c == ')';
+}
+
+/* The tokenizer drops punctuation, so a term made of nothing else would be
+ * an empty phrase that matches no rows */
+static bool local_has_word(const char* str, size_t len) {
+	for (size_t i = 0; i < len; ++i) {
+		if (isalnum((unsigned char)str[i]) || (unsigned char)str[i] >= 0x80)
+			return true;
+	}
+	return false;
+}
+
+static inline bool local_is_op(const char* start, size_t len, const char* op) {
+	return len == strlen(op) && strncmp(start, op, len) == 0;
+}
+
+static const char* local_column_prefix(const char* str, size_t* outLen) {
+	static const char* columns[] = { "title", "body" };
+	for (size_t i = 0; i < sizeof(columns) / sizeof(*columns); ++i) {
+		size_t len = 0;
+		while (columns[i][len] != '\0'
+			&& tolower((unsigned char)str[len]) == columns[i][len])
+		{
+			len++;
+		}
+		if (columns[i][len] == '\0' && str[len] == ':') {
+			*outLen = len + 1;
+			return columns[i];
+		}
+	}
+	return NULL;
+}
+
+bool search_compile(const char* input, char** outExpr) {
+	SearchOutput out = { .str = NULL, .len = 0, .capacity = 0 };
+	SearchGroup groups[SEARCH_MAX_DEPTH];
+	int depth = 0;
+	bool haveLeft = false;
+	const char* op = NULL;
+	const char* column = NULL;
+	bool excludeNext = false;
+	local_emit(&out, "", 0);
+	const char* p = input;
+	while (*p != '\0') {
+		if (isspace((unsigned char)*p)) {
+			p++;
+			continue;
+		}
+		if (*p == '(') {
+			p++;
+			if (depth == SEARCH_MAX_DEPTH)
+				continue;
+			groups[depth].start = out.len;
+			groups[depth].haveLeft = haveLeft;
+			depth++;
+			if (haveLeft)
+				local_emit_op(&out, op);
+			// title:(a b) filters the whole group, its terms are then left bare
+			if (column != NULL) {
+				local_emit_str(&out, column);
+				local_emit_str(&out, " : ");
+			}
+			local_emit_str(&out, "(");
+			haveLeft = false;
+			op = NULL;
+			column = NULL;
+			continue;
+		}
+		if (*p == ')') {
+			p++;
+			if (depth == 0)
+				continue;
+			depth--;
+			if (haveLeft)
+				local_emit_str(&out, ")");
+			else {
+				// Empty groups are not valid FTS5, drop the whole group
+				out.len = groups[depth].start;
+				out.str[out.len] = '\0';
+			}
+			haveLeft = haveLeft || groups[depth].haveLeft;
+			op = NULL;
+			continue;
+		}
+		bool exclude = false;
+		if (*p == '-' && !local_is_break(p[1])) {
+			exclude = true;
+			p++;
+		}
+		size_t prefixLen = 0;
+		const char* termColumn = local_column_prefix(p, &prefixLen);
+		if (termColumn != NULL) {
+			p += prefixLen;
+			if (local_is_break(*p)) {
+				column = termColumn;
+				continue;
+			}
+		} else
+			termColumn = column;
+		const char* start;
+		size_t len;
+		bool prefix = false;
+		if (*p == '"') {
+			start = ++p;
+			while (*p != '\0' && *p != '"')
+				p++;
+			len = (size_t)(p - start);
+			if (*p == '"')
+				p++;
+		} else {
+			start = p;
+			while (!local_is_break(*p) && *p != '"')
+				p++;
+			len = (size_t)(p - start);
+			if (termColumn == NULL && !exclude) {
+				const char* binary = NULL;
+				if (local_is_op(start, len, "AND"))
+					binary = "AND";
+				else if (local_is_op(start, len, "OR"))
+					binary = "OR";
+				else if (local_is_op(start, len, "NOT"))
+					binary = "NOT";
+				if (binary != NULL) {
+					if (haveLeft)
+						op = binary;
+					else if (binary[0] == 'N')
+						excludeNext = true;
+					continue;
+				}
+			}
+			while (len > 0 && start[len - 1] == '*') {
+				prefix = true;
+				len--;
+			}
+		}
+		column = NULL;
+		exclude = exclude || excludeNext;
+		excludeNext = false;
+		if (!local_has_word(start, len) || (exclude && !haveLeft))
+			continue;
+		if (haveLeft)
+			local_emit_op(&out, exclude ? "NOT" : op);
+		if (termColumn != NULL) {
+			local_emit_str(&out, termColumn);
+			local_emit_str(&out, " : ");
+		}
+		local_emit_phrase(&out, start, len);
+		if (prefix)
+			local_emit_str(&out, " *");
+		haveLeft = true;
+		op = NULL;
+	}
+	while (depth > 0) {
+		depth--;
+		if (haveLeft)
+			local_emit_str(&out, ")");
+		else {
+			out.len = groups[depth].start;
+			out.str[out.len] = '\0';
+		}
+		haveLeft = haveLeft || groups[depth].haveLeft;
+	}
+	if (out.len == 0) {
+		free(out.str);
+		*outExpr = NULL;
+		return false;
+	}
+	*outExpr = out.str;
+	return true;
+}
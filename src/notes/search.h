@@ -0,0 +1,19 @@
+#ifndef NOTECOMMANDER_SEARCH_H
+#define NOTECOMMANDER_SEARCH_H
+
+#include <stdbool.h>
+
+/******************************************************************************\
+* Compiles user search input into a single FTS5 query expression so that one
+* MATCH against the whole table covers every column. Bare words and "phrases"
+* are quoted, word* is a prefix query, title:word and body:word restrict a term
+* (or a group in parentheses) to one column, -word excludes a term and AND, OR,
+* NOT and parentheses are kept as operators. Operators without operands and
+* terms with no letters or digits are dropped
+* Returns:   False if the input has nothing to search for
+* Parameter: input The text the user typed
+* Parameter: outExpr The allocated expression, free it with free()
+\******************************************************************************/
+bool search_compile(const char* input, char** outExpr);
+
+#endif
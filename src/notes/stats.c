@@ -0,0 +1,197 @@
+#include "notes.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <db/query.h>
+#include <display/ui.h>
+#include <libc/string.h>
+
+#define STATS_TOP_TERMS		10
+#define STATS_TERM_SIZE		32
+#define STATS_REPORT_SIZE	8192
+#define STATS_MAX_SEGMENTS	8		/* More than this and compact is suggested */
+// fts5vocab lists every term in the index, it lives in temp so it can be
+// made on a read only (or snapshot) connection
+#define STATS_VOCAB_FORMAT	"CREATE VIRTUAL TABLE IF NOT EXISTS temp.`NotesVocab` " \
+	"USING fts5vocab(main, 'Notes', 'row')"
+#define STATS_TERMS_FORMAT	"SELECT `term`, `doc`, `cnt` FROM temp.`NotesVocab`"
+#define STATS_NOTES_FORMAT	"SELECT count(*), total(`size`), total(typeof(`body`)='blob') FROM `NoteData`"
+#define STATS_SEGMENTS_FORMAT	"SELECT count(DISTINCT `segid`) FROM `Notes_idx`"
+#define STATS_FILE_FORMAT	"SELECT * FROM pragma_page_count(), pragma_freelist_count(), pragma_page_size()"
+// In aggregate mode dbstat has one row per table or index, where pageno is
+// the number of pages it uses and pgsize their total size
+#define STATS_TABLES_FORMAT	"SELECT `name`, `pageno`, `pgsize`, `unused` FROM dbstat " \
+	"WHERE `aggregate`=TRUE ORDER BY `pgsize` DESC"
+
+typedef struct {
+	char term[STATS_TERM_SIZE];
+	int64_t docs;
+	int64_t count;
+} StatsTerm;
+
+typedef struct {
+	DbJob job;
+	InputState* state;
+	double start;
+	int32_t failed;
+	int len;
+	char report[STATS_REPORT_SIZE];
+} StatsJob;
+
+static inline double local_now() {
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0;
+}
+
+static void local_report(StatsJob* stats, const char* format, ...) {
+	if (stats->len >= (int)sizeof(stats->report))
+		return;
+	va_list args;
+	va_start(args, format);
+	int len = vsnprintf(stats->report + stats->len,
+		sizeof(stats->report) - (size_t)stats->len, format, args);
+	va_end(args);
+	if (len > 0)
+		stats->len += len;
+}
+
+static inline double local_mb(double bytes) {
+	return bytes / (1024.0 * 1024.0);
+}
+
+/* Counts every term in one pass over the vocabulary, keeping the most used */
+static int64_t local_scan_terms(QueryCache* queries, StatsTerm* top, int32_t* outTop) {
+	int64_t terms = 0;
+	*outTop = 0;
+	if (query_cache_exec(queries, STATS_VOCAB_FORMAT) != QUERY_OK)
+		return -1;
+	sqlite3_stmt* pStmt = query_cache_get(queries, STATS_TERMS_FORMAT);
+	if (pStmt == NULL)
+		return -1;
+	int res;
+	while ((res = query_step(pStmt)) == QUERY_ROW) {
+		terms++;
+		int64_t count = sqlite3_column_int64(pStmt, 2);
+		if (*outTop == STATS_TOP_TERMS && count <= top[STATS_TOP_TERMS - 1].count)
+			continue;
+		int32_t at = *outTop < STATS_TOP_TERMS ? (*outTop)++ : STATS_TOP_TERMS - 1;
+		while (at > 0 && top[at - 1].count < count) {
+			top[at] = top[at - 1];
+			at--;
+		}
+		snprintf(top[at].term, sizeof(top[at].term), "%s", (const char*)sqlite3_column_text(pStmt, 0));
+		top[at].docs = sqlite3_column_int64(pStmt, 1);
+		top[at].count = count;
+	}
+	query_done(pStmt);
+	return res == QUERY_OK ? terms : -1;
+}
+
+static void local_stats_run(DbJob* job, sqlite3* db, QueryCache* queries) {
+	StatsJob* stats = (StatsJob*)job;
+	int64_t notes = 0, compressed = 0, segments = 0;
+	double text = 0.0;
+	sqlite3_stmt* pStmt = query_cache_get(queries, STATS_NOTES_FORMAT);
+	if (pStmt != NULL && query_step(pStmt) == QUERY_ROW) {
+		notes = sqlite3_column_int64(pStmt, 0);
+		text = sqlite3_column_double(pStmt, 1);
+		compressed = sqlite3_column_int64(pStmt, 2);
+	} else
+		stats->failed++;
+	if (pStmt != NULL)
+		query_done(pStmt);
+	local_report(stats, "Notes: %lld, %.2f MB of text, %lld stored compressed\n",
+		(long long)notes, local_mb(text), (long long)compressed);
+	pStmt = query_cache_get(queries, STATS_SEGMENTS_FORMAT);
+	if (pStmt != NULL && query_step(pStmt) == QUERY_ROW)
+		segments = sqlite3_column_int64(pStmt, 0);
+	if (pStmt != NULL)
+		query_done(pStmt);
+	StatsTerm top[STATS_TOP_TERMS];
+	int32_t topCount;
+	int64_t terms = local_scan_terms(queries, top, &topCount);
+	if (terms < 0)
+		stats->failed++;
+	local_report(stats, "Search index: %lld distinct terms in %lld segments\n",
+		(long long)terms, (long long)segments);
+	int64_t pages = 0, freePages = 0, pageSize = 0;
+	pStmt = query_cache_get(queries, STATS_FILE_FORMAT);
+	if (pStmt != NULL && query_step(pStmt) == QUERY_ROW) {
+		pages = sqlite3_column_int64(pStmt, 0);
+		freePages = sqlite3_column_int64(pStmt, 1);
+		pageSize = sqlite3_column_int64(pStmt, 2);
+	}
+	if (pStmt != NULL)
+		query_done(pStmt);
+	local_report(stats, "File: %.2f MB, %lld pages of %lld bytes, %lld free\n",
+		local_mb((double)(pages * pageSize)), (long long)pages,
+		(long long)pageSize, (long long)freePages);
+	// Tables and indexes that belong to the FTS5 index are its shadow tables
+	char tables[STATS_REPORT_SIZE / 2];
+	int tablesLen = 0;
+	double indexBytes = 0.0, contentBytes = 0.0;
+	pStmt = query_cache_get(queries, STATS_TABLES_FORMAT);
+	if (pStmt != NULL) {
+		while (query_step(pStmt) == QUERY_ROW) {
+			const char* name = (const char*)sqlite3_column_text(pStmt, 0);
+			double bytes = sqlite3_column_double(pStmt, 2);
+			double unused = sqlite3_column_double(pStmt, 3);
+			if (stridxof(name, "Notes_", 0) == 0 || stridxof(name, "NotesTrigram_", 0) == 0)
+				indexBytes += bytes;
+			else
+				contentBytes += bytes;
+			if (tablesLen < (int)sizeof(tables)) {
+				int len = snprintf(tables + tablesLen, sizeof(tables) - (size_t)tablesLen,
+					"  %-20s %8lld pages %9.2f MB %4.0f%% unused\n", name,
+					(long long)sqlite3_column_int64(pStmt, 1), local_mb(bytes),
+					bytes > 0.0 ? unused * 100.0 / bytes : 0.0);
+				if (len > 0)
+					tablesLen += len;
+			}
+		}
+		query_done(pStmt);
+		local_report(stats, "Content %.2f MB, index %.2f MB (%.2fx the content)\n",
+			local_mb(contentBytes), local_mb(indexBytes),
+			contentBytes > 0.0 ? indexBytes / contentBytes : 0.0);
+	} else
+		local_report(stats, "Page usage is not available, dbstat is not in this build\n");
+	if (segments > STATS_MAX_SEGMENTS)
+		local_report(stats, "The index has %lld segments, compact merges them into one\n",
+			(long long)segments);
+	if (freePages > 0 && pages > 0 && freePages * 10 > pages)
+		local_report(stats, "%.2f MB of the file is free pages, VACUUM would return it\n",
+			local_mb((double)(freePages * pageSize)));
+	local_report(stats, "\nMost used terms (occurrences in notes):\n");
+	for (int32_t i = 0; i < topCount; ++i) {
+		local_report(stats, "  %-20s %10lld in %lld\n", top[i].term,
+			(long long)top[i].count, (long long)top[i].docs);
+	}
+	if (tablesLen > 0)
+		local_report(stats, "\nPages by table and index:\n%s", tables);
+}
+
+static void local_stats_done(DbJob* job) {
+	StatsJob* stats = (StatsJob*)job;
+	if (!job->cancelled) {
+		char* output = malloc(sizeof(stats->report) + 128);
+		snprintf(output, sizeof(stats->report) + 128, "Notebook statistics (%.2f sec)%s\n%s",
+			local_now() - stats->start,
+			stats->failed > 0 ? ", some figures could not be read" : "", stats->report);
+		ui_clear_and_print(stats->state->ui, output);
+		free(output);
+	}
+	free(stats);
+}
+
+void notes_stats(Notes* notes, InputState* state) {
+	StatsJob* stats = calloc(1, sizeof(*stats));
+	stats->job.run = local_stats_run;
+	stats->job.done = local_stats_done;
+	stats->state = state;
+	stats->start = local_now();
+	ui_clear_and_print(state->ui, "Gathering statistics...");
+	notes_run_job(notes, &stats->job);
+}
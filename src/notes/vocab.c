@@ -0,0 +1,451 @@
+#include "vocab.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <stdatomic.h>
+#include <db/query.h>
+
+#define VOCAB_EXTRA_MAX			4096	/* Terms added since loading before a reload is wanted */
+#define VOCAB_MAX_TERM			256
+#define VOCAB_PROGRESS_OPS		10000
+#define VOCAB_TOKENIZER			"unicode61"
+// fts5vocab lists the terms in index order, which is memcmp order, so the
+// array is sorted as it is read
+#define VOCAB_TABLE_FORMAT		"CREATE VIRTUAL TABLE temp.`NotesVocab` USING fts5vocab(main, 'Notes', 'row')"
+#define VOCAB_TERMS_FORMAT		"SELECT `term`, `doc` FROM temp.`NotesVocab`"
+
+/* A term that was not in the index when the vocabulary was loaded */
+typedef struct {
+	char* term;
+	uint32_t docs;
+} VocabExtra;
+
+struct NotesVocab {
+	char* arena;
+	size_t arenaLen;
+	size_t arenaCapacity;
+	uint32_t* offsets;		/* Sorted terms, each one at arena + offset */
+	uint32_t* docs;
+	int32_t count;
+	int32_t capacity;
+	int32_t* tree;			/* Segment tree of the term with the most docs */
+	int32_t leaves;
+	VocabExtra* extra;		/* Sorted like the terms, but kept apart */
+	int32_t extraCount;
+	int32_t extraCapacity;
+	fts5_tokenizer tokenizer;
+	Fts5Tokenizer* tok;		/* Looked up once, see vocab_open_tokenizer */
+};
+
+struct NotesVocabLoader {
+	thrd_t thread;
+	const char* path;
+	const DbSnapshot* snapshot;
+	NotesVocab* vocab;
+	atomic_bool done;
+	atomic_bool cancel;
+};
+
+/* A lower bound and its exclusive end, with the term holding the most docs */
+typedef struct {
+	int32_t lo;
+	int32_t hi;
+	int32_t best;
+} VocabRange;
+
+typedef struct {
+	char* data;
+	size_t len;
+	size_t capacity;
+	size_t* starts;
+	int32_t count;
+	int32_t capacity2;
+} VocabTokens;
+
+typedef struct {
+	int32_t start;
+	int32_t end;
+	int32_t len;
+	char term[VOCAB_MAX_TERM];
+} VocabLastToken;
+
+static inline const char* local_term(const NotesVocab* vocab, int32_t idx) {
+	return vocab->arena + vocab->offsets[idx];
+}
+
+static inline int32_t local_better(const NotesVocab* vocab, int32_t a, int32_t b) {
+	if (a < 0)
+		return b;
+	else if (b < 0)
+		return a;
+	// Ties go to the term that sorts first
+	if (vocab->docs[a] != vocab->docs[b])
+		return vocab->docs[a] > vocab->docs[b] ? a : b;
+	return a < b ? a : b;
+}
+
+static void local_build_tree(NotesVocab* vocab) {
+	vocab->leaves = 1;
+	while (vocab->leaves < vocab->count)
+		vocab->leaves *= 2;
+	vocab->tree = malloc(sizeof(int32_t) * 2 * (size_t)vocab->leaves);
+	for (int32_t i = 0; i < vocab->leaves; ++i)
+		vocab->tree[vocab->leaves + i] = i < vocab->count ? i : -1;
+	for (int32_t i = vocab->leaves - 1; i >= 1; --i)
+		vocab->tree[i] = local_better(vocab, vocab->tree[2 * i], vocab->tree[2 * i + 1]);
+}
+
+static void local_update_tree(NotesVocab* vocab, int32_t idx) {
+	for (int32_t i = (idx + vocab->leaves) / 2; i >= 1; i /= 2)
+		vocab->tree[i] = local_better(vocab, vocab->tree[2 * i], vocab->tree[2 * i + 1]);
+}
+
+/* The term with the most docs in [lo, hi) */
+static int32_t local_range_best(const NotesVocab* vocab, int32_t lo, int32_t hi) {
+	int32_t best = -1;
+	for (lo += vocab->leaves, hi += vocab->leaves; lo < hi; lo /= 2, hi /= 2) {
+		if (lo & 1)
+			best = local_better(vocab, best, vocab->tree[lo++]);
+		if (hi & 1)
+			best = local_better(vocab, best, vocab->tree[--hi]);
+	}
+	return best;
+}
+
+/* The first term that is not less than the prefix (only its first len bytes are compared) */
+static int32_t local_lower_bound(const NotesVocab* vocab, const char* prefix, size_t len, bool past) {
+	int32_t lo = 0, hi = vocab->count;
+	while (lo < hi) {
+		int32_t mid = lo + (hi - lo) / 2;
+		int cmp = strncmp(local_term(vocab, mid), prefix, len);
+		if (cmp < 0 || (past && cmp == 0))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static int32_t local_extra_lower_bound(const NotesVocab* vocab, const char* prefix, size_t len, bool past) {
+	int32_t lo = 0, hi = vocab->extraCount;
+	while (lo < hi) {
+		int32_t mid = lo + (hi - lo) / 2;
+		int cmp = strncmp(vocab->extra[mid].term, prefix, len);
+		if (cmp < 0 || (past && cmp == 0))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static bool local_append_term(NotesVocab* vocab, const char* term, size_t len, uint32_t docs) {
+	if (vocab->arenaCapacity - vocab->arenaLen < len + 1) {
+		size_t capacity = vocab->arenaCapacity > 0 ? vocab->arenaCapacity * 2 : 64 * 1024;
+		while (capacity - vocab->arenaLen < len + 1)
+			capacity *= 2;
+		char* arena = realloc(vocab->arena, capacity);
+		if (arena == NULL)
+			return false;
+		vocab->arena = arena;
+		vocab->arenaCapacity = capacity;
+	}
+	if (vocab->count == vocab->capacity) {
+		int32_t capacity = vocab->capacity > 0 ? vocab->capacity * 2 : 4096;
+		uint32_t* offsets = realloc(vocab->offsets, sizeof(uint32_t) * (size_t)capacity);
+		if (offsets == NULL)
+			return false;
+		vocab->offsets = offsets;
+		uint32_t* counts = realloc(vocab->docs, sizeof(uint32_t) * (size_t)capacity);
+		if (counts == NULL)
+			return false;
+		vocab->docs = counts;
+		vocab->capacity = capacity;
+	}
+	memcpy(vocab->arena + vocab->arenaLen, term, len);
+	vocab->arena[vocab->arenaLen + len] = '\0';
+	vocab->offsets[vocab->count] = (uint32_t)vocab->arenaLen;
+	vocab->docs[vocab->count] = docs;
+	vocab->count++;
+	vocab->arenaLen += len + 1;
+	return true;
+}
+
+static int local_load_cancelled(void* state) {
+	return atomic_load(&((NotesVocabLoader*)state)->cancel);
+}
+
+static NotesVocab* local_read_vocab(sqlite3* db) {
+	sqlite3_stmt* pStmt = NULL;
+	if (sqlite3_exec(db, VOCAB_TABLE_FORMAT, NULL, NULL, NULL) != SQLITE_OK
+		|| sqlite3_prepare_v2(db, VOCAB_TERMS_FORMAT, -1, &pStmt, NULL) != SQLITE_OK)
+	{
+		return NULL;
+	}
+	NotesVocab* vocab = calloc(1, sizeof(*vocab));
+	int rc;
+	bool ok = true;
+	while (ok && (rc = sqlite3_step(pStmt)) == SQLITE_ROW) {
+		ok = local_append_term(vocab, (const char*)sqlite3_column_text(pStmt, 0),
+			(size_t)sqlite3_column_bytes(pStmt, 0), (uint32_t)sqlite3_column_int64(pStmt, 1));
+	}
+	sqlite3_finalize(pStmt);
+	if (!ok || rc != SQLITE_DONE) {
+		vocab_free(vocab);
+		return NULL;
+	}
+	local_build_tree(vocab);
+	return vocab;
+}
+
+static int local_loader_main(void* arg) {
+	NotesVocabLoader* loader = arg;
+	sqlite3* db = NULL;
+	bool opened = loader->snapshot != NULL ? db_snapshot_open(loader->snapshot, &db)
+		: sqlite3_open_v2(loader->path, &db, SQLITE_OPEN_READONLY, NULL) == SQLITE_OK;
+	if (opened) {
+		sqlite3_busy_timeout(db, DB_BUSY_TIMEOUT);
+		sqlite3_progress_handler(db, VOCAB_PROGRESS_OPS, local_load_cancelled, loader);
+		loader->vocab = local_read_vocab(db);
+	}
+	sqlite3_close(db);
+	atomic_store(&loader->done, true);
+	return 0;
+}
+
+NotesVocabLoader* vocab_loader_start(const char* path, const DbSnapshot* snapshot) {
+	NotesVocabLoader* loader = calloc(1, sizeof(*loader));
+	loader->path = path;
+	loader->snapshot = snapshot;
+	if (thrd_create(&loader->thread, local_loader_main, loader) != thrd_success) {
+		free(loader);
+		return NULL;
+	}
+	return loader;
+}
+
+bool vocab_loader_poll(NotesVocabLoader* loader, NotesVocab** outVocab) {
+	*outVocab = NULL;
+	if (!atomic_load(&loader->done))
+		return false;
+	thrd_join(loader->thread, NULL);
+	*outVocab = loader->vocab;
+	free(loader);
+	return true;
+}
+
+void vocab_loader_cancel(NotesVocabLoader* loader) {
+	atomic_store(&loader->cancel, true);
+	thrd_join(loader->thread, NULL);
+	if (loader->vocab != NULL)
+		vocab_free(loader->vocab);
+	free(loader);
+}
+
+void vocab_free(NotesVocab* vocab) {
+	if (vocab->tok != NULL)
+		vocab->tokenizer.xDelete(vocab->tok);
+	for (int32_t i = 0; i < vocab->extraCount; ++i)
+		free(vocab->extra[i].term);
+	free(vocab->extra);
+	free(vocab->tree);
+	free(vocab->docs);
+	free(vocab->offsets);
+	free(vocab->arena);
+	free(vocab);
+}
+
+bool vocab_open_tokenizer(NotesVocab* vocab, sqlite3* db) {
+	if (vocab->tok != NULL)
+		return true;
+	fts5_api* api = NULL;
+	sqlite3_stmt* pStmt;
+	if (sqlite3_prepare_v2(db, "SELECT fts5(?1)", -1, &pStmt, NULL) == SQLITE_OK) {
+		sqlite3_bind_pointer(pStmt, 1, (void*)&api, "fts5_api_ptr", NULL);
+		sqlite3_step(pStmt);
+	}
+	sqlite3_finalize(pStmt);
+	void* userData;
+	if (api == NULL || api->xFindTokenizer(api, VOCAB_TOKENIZER, &userData, &vocab->tokenizer) != SQLITE_OK
+		|| vocab->tokenizer.xCreate(userData, NULL, 0, &vocab->tok) != SQLITE_OK)
+	{
+		vocab->tok = NULL;
+		return false;
+	}
+	return true;
+}
+
+static bool local_tokenize(const NotesVocab* vocab, const char* text, int32_t len, int flags, void* ctx,
+	int (*callback)(void*, int, const char*, int, int, int))
+{
+	return vocab->tok != NULL
+		&& vocab->tokenizer.xTokenize(vocab->tok, ctx, flags, text, len, callback) == SQLITE_OK;
+}
+
+static int local_collect_token(void* ctx, int flags, const char* token, int len, int start, int end) {
+	VocabTokens* tokens = ctx;
+	if ((flags & FTS5_TOKEN_COLOCATED) || len <= 0)
+		return SQLITE_OK;
+	if (tokens->capacity - tokens->len < (size_t)len + 1) {
+		size_t capacity = tokens->capacity > 0 ? tokens->capacity * 2 : 4096;
+		while (capacity - tokens->len < (size_t)len + 1)
+			capacity *= 2;
+		tokens->data = realloc(tokens->data, capacity);
+		tokens->capacity = capacity;
+	}
+	if (tokens->count == tokens->capacity2) {
+		tokens->capacity2 = tokens->capacity2 > 0 ? tokens->capacity2 * 2 : 256;
+		tokens->starts = realloc(tokens->starts, sizeof(size_t) * (size_t)tokens->capacity2);
+	}
+	memcpy(tokens->data + tokens->len, token, (size_t)len);
+	tokens->data[tokens->len + (size_t)len] = '\0';
+	tokens->starts[tokens->count++] = tokens->len;
+	tokens->len += (size_t)len + 1;
+	return SQLITE_OK;
+}
+
+static int local_compare_terms(const void* a, const void* b) {
+	return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+/* One more note holds the term */
+static bool local_bump(NotesVocab* vocab, const char* term) {
+	size_t len = strlen(term) + 1;
+	int32_t idx = local_lower_bound(vocab, term, len, false);
+	if (idx < vocab->count && strcmp(local_term(vocab, idx), term) == 0) {
+		vocab->docs[idx]++;
+		local_update_tree(vocab, idx);
+		return true;
+	}
+	idx = local_extra_lower_bound(vocab, term, len, false);
+	if (idx < vocab->extraCount && strcmp(vocab->extra[idx].term, term) == 0) {
+		vocab->extra[idx].docs++;
+		return true;
+	}
+	if (vocab->extraCount == VOCAB_EXTRA_MAX)
+		return false;
+	if (vocab->extraCount == vocab->extraCapacity) {
+		vocab->extraCapacity = vocab->extraCapacity > 0 ? vocab->extraCapacity * 2 : 64;
+		vocab->extra = realloc(vocab->extra, sizeof(VocabExtra) * (size_t)vocab->extraCapacity);
+	}
+	memmove(vocab->extra + idx + 1, vocab->extra + idx,
+		sizeof(VocabExtra) * (size_t)(vocab->extraCount - idx));
+	vocab->extra[idx].term = malloc(len);
+	memcpy(vocab->extra[idx].term, term, len);
+	vocab->extra[idx].docs = 1;
+	vocab->extraCount++;
+	return true;
+}
+
+bool vocab_add_note(NotesVocab* vocab, const char* title,
+	int32_t titleLen, const char* body, int32_t bodyLen)
+{
+	VocabTokens tokens = { 0 };
+	bool ok = local_tokenize(vocab, title, titleLen, FTS5_TOKENIZE_DOCUMENT, &tokens, local_collect_token)
+		&& local_tokenize(vocab, body, bodyLen, FTS5_TOKENIZE_DOCUMENT, &tokens, local_collect_token);
+	if (ok && tokens.count > 0) {
+		// A note counts once per term however often the term is in it
+		const char** terms = malloc(sizeof(char*) * (size_t)tokens.count);
+		for (int32_t i = 0; i < tokens.count; ++i)
+			terms[i] = tokens.data + tokens.starts[i];
+		qsort(terms, (size_t)tokens.count, sizeof(char*), local_compare_terms);
+		for (int32_t i = 0; ok && i < tokens.count; ++i) {
+			if (i == 0 || strcmp(terms[i], terms[i - 1]) != 0)
+				ok = local_bump(vocab, terms[i]);
+		}
+		free(terms);
+	}
+	free(tokens.starts);
+	free(tokens.data);
+	return ok;
+}
+
+static int local_last_token(void* ctx, int flags, const char* token, int len, int start, int end) {
+	VocabLastToken* last = ctx;
+	if ((flags & FTS5_TOKEN_COLOCATED) || len <= 0 || len >= VOCAB_MAX_TERM)
+		return SQLITE_OK;
+	last->start = start;
+	last->end = end;
+	last->len = len;
+	memcpy(last->term, token, (size_t)len);
+	last->term[len] = '\0';
+	return SQLITE_OK;
+}
+
+/* The terms with the most docs in [lo, hi), most first */
+static int32_t local_top(const NotesVocab* vocab, int32_t lo, int32_t hi, int32_t* outIdx) {
+	// Every pick takes one range and leaves at most two, so K picks need K + 1
+	VocabRange ranges[VOCAB_MAX_COMPLETIONS + 1];
+	int32_t rangeCount = 0, found = 0;
+	if (lo < hi)
+		ranges[rangeCount++] = (VocabRange){ lo, hi, local_range_best(vocab, lo, hi) };
+	while (found < VOCAB_MAX_COMPLETIONS && rangeCount > 0) {
+		int32_t pick = 0;
+		for (int32_t i = 1; i < rangeCount; ++i) {
+			if (local_better(vocab, ranges[pick].best, ranges[i].best) == ranges[i].best)
+				pick = i;
+		}
+		VocabRange range = ranges[pick];
+		ranges[pick] = ranges[--rangeCount];
+		outIdx[found++] = range.best;
+		if (range.lo < range.best) {
+			ranges[rangeCount++] = (VocabRange){ range.lo, range.best,
+				local_range_best(vocab, range.lo, range.best) };
+		}
+		if (range.best + 1 < range.hi) {
+			ranges[rangeCount++] = (VocabRange){ range.best + 1, range.hi,
+				local_range_best(vocab, range.best + 1, range.hi) };
+		}
+	}
+	return found;
+}
+
+int32_t vocab_complete(const NotesVocab* vocab, const char* text,
+	int32_t* outStart, const char** outTerms)
+{
+	int32_t len = (int32_t)strlen(text);
+	int32_t wordStart = len;
+	while (wordStart > 0 && text[wordStart - 1] != ' ' && text[wordStart - 1] != '\t')
+		wordStart--;
+	// Only a word being typed is completed, "title:al" completes "al" and
+	// anything that ends with a separator has nothing left to complete
+	VocabLastToken last = { .len = 0 };
+	if (wordStart == len || !local_tokenize(vocab, text + wordStart, len - wordStart,
+		FTS5_TOKENIZE_QUERY | FTS5_TOKENIZE_PREFIX, &last, local_last_token)
+		|| last.len == 0 || wordStart + last.end != len)
+	{
+		return 0;
+	}
+	*outStart = wordStart + last.start;
+	size_t prefixLen = (size_t)last.len;
+	int32_t top[VOCAB_MAX_COMPLETIONS];
+	int32_t topCount = local_top(vocab, local_lower_bound(vocab, last.term, prefixLen, false),
+		local_lower_bound(vocab, last.term, prefixLen, true), top);
+	// The few terms added since loading are ranked with a plain insertion
+	const VocabExtra* extra[VOCAB_MAX_COMPLETIONS];
+	int32_t extraCount = 0;
+	int32_t extraEnd = local_extra_lower_bound(vocab, last.term, prefixLen, true);
+	for (int32_t i = local_extra_lower_bound(vocab, last.term, prefixLen, false); i < extraEnd; ++i) {
+		int32_t at = extraCount < VOCAB_MAX_COMPLETIONS ? extraCount++ : VOCAB_MAX_COMPLETIONS;
+		while (at > 0 && extra[at - 1]->docs < vocab->extra[i].docs) {
+			if (at < VOCAB_MAX_COMPLETIONS)
+				extra[at] = extra[at - 1];
+			at--;
+		}
+		if (at < VOCAB_MAX_COMPLETIONS)
+			extra[at] = &vocab->extra[i];
+	}
+	int32_t count = 0, t = 0, e = 0;
+	while (count < VOCAB_MAX_COMPLETIONS && (t < topCount || e < extraCount)) {
+		if (e == extraCount || (t < topCount && vocab->docs[top[t]] >= extra[e]->docs))
+			outTerms[count++] = local_term(vocab, top[t++]);
+		else
+			outTerms[count++] = extra[e++]->term;
+	}
+	return count;
+}
+
+int64_t vocab_count(const NotesVocab* vocab) {
+	return (int64_t)vocab->count + vocab->extraCount;
+}
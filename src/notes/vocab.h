@@ -0,0 +1,70 @@
+#ifndef NOTECOMMANDER_VOCAB_H
+#define NOTECOMMANDER_VOCAB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <db/snapshot.h>
+#include <ext/sqlite3.h>
+
+#define VOCAB_MAX_COMPLETIONS	8
+
+typedef struct NotesVocab NotesVocab;
+typedef struct NotesVocabLoader NotesVocabLoader;
+
+/******************************************************************************\
+* Start reading the search index vocabulary on a thread of its own, with a
+* read only connection to the database (or to the snapshot when not NULL)
+* Returns:   The loader or NULL if the thread could not be started
+\******************************************************************************/
+NotesVocabLoader* vocab_loader_start(const char* path, const DbSnapshot* snapshot);
+
+/******************************************************************************\
+* Check on a loader without blocking, once it has finished it is freed
+* Returns:   True when the loader is finished, outVocab is then the loaded
+*            vocabulary or NULL if it could not be read
+\******************************************************************************/
+bool vocab_loader_poll(NotesVocabLoader* loader, NotesVocab** outVocab);
+
+/******************************************************************************\
+* Stop a loader that has not finished (waiting for its thread) and free it
+\******************************************************************************/
+void vocab_loader_cancel(NotesVocabLoader* loader);
+
+void vocab_free(NotesVocab* vocab);
+
+/******************************************************************************\
+* Look up the FTS5 tokenizer of the index once, so that terms are folded the
+* way they were indexed without asking the database on every completion
+* Returns:   False if the tokenizer could not be found or created
+* Parameter: db A connection to get the FTS5 tokenizer from, the vocabulary
+*            must be freed before it is closed
+\******************************************************************************/
+bool vocab_open_tokenizer(NotesVocab* vocab, sqlite3* db);
+
+/******************************************************************************\
+* Count the terms of a note just written to the index, using the tokenizer of
+* the index so that terms match what was indexed
+* Returns:   False if the note could not be tokenized or too many new terms
+*            have been added, the vocabulary should then be loaded again
+\******************************************************************************/
+bool vocab_add_note(NotesVocab* vocab, const char* title,
+	int32_t titleLen, const char* body, int32_t bodyLen);
+
+/******************************************************************************\
+* Complete the last word of some search text, ranked by how many notes hold
+* each term. The word is folded by the index tokenizer before it is looked up
+* Returns:   The number of completions written to outTerms, the terms are only
+*            valid until the vocabulary is next changed or freed
+* Parameter: text The search text, its last word is completed
+* Parameter: outStart The offset in text where the completed word starts
+* Parameter: outTerms Up to VOCAB_MAX_COMPLETIONS terms, most used first
+\******************************************************************************/
+int32_t vocab_complete(const NotesVocab* vocab, const char* text,
+	int32_t* outStart, const char** outTerms);
+
+/******************************************************************************\
+* Returns:   The number of distinct terms
+\******************************************************************************/
+int64_t vocab_count(const NotesVocab* vocab);
+
+#endif
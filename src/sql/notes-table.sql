@@ -1,2 +1,61 @@
--- Create an FTS table
-CREATE VIRTUAL TABLE Notes USING fts5(title, body);
\ No newline at end of file
+-- Note rows, the body is the last column so reading metadata skips its pages.
+-- Bodies are stored as an LZ compressed BLOB when that makes them smaller,
+-- size is always the length of the uncompressed text
+CREATE TABLE NoteData (
+	id INTEGER PRIMARY KEY,
+	title TEXT NOT NULL,
+	created INTEGER NOT NULL,
+	updated INTEGER NOT NULL,
+	size INTEGER NOT NULL,
+	flags INTEGER NOT NULL DEFAULT 0,
+	hash INTEGER,
+	body TEXT NOT NULL
+);
+CREATE INDEX NoteDataUpdated ON NoteData (updated);
+-- XXH64 of the title and text, a note whose hash and text match an existing
+-- note is not written twice. One that only collides is stored with a NULL hash
+CREATE UNIQUE INDEX NoteDataHash ON NoteData (hash);
+
+-- The text of every note, nc_body is registered by the application
+CREATE VIEW NoteText AS SELECT id, title, nc_body(body, size) AS body FROM NoteData;
+
+-- Create an FTS table indexing the note text without keeping its own copy
+CREATE VIRTUAL TABLE Notes USING fts5(title, body, content='NoteText', content_rowid='id', prefix='2 3 4');
+
+-- Let segments pile up a little before merging, idle time merges the rest
+INSERT INTO Notes (Notes, rank) VALUES ('automerge', 8);
+INSERT INTO Notes (Notes, rank) VALUES ('crisismerge', 32);
+
+-- Keep the index in sync with NoteData
+CREATE TRIGGER NoteDataInsert AFTER INSERT ON NoteData BEGIN
+	INSERT INTO Notes (rowid, title, body) VALUES (new.id, new.title, nc_body(new.body, new.size));
+END;
+CREATE TRIGGER NoteDataDelete AFTER DELETE ON NoteData BEGIN
+	INSERT INTO Notes (Notes, rowid, title, body) VALUES ('delete', old.id, old.title, nc_body(old.body, old.size));
+END;
+CREATE TRIGGER NoteDataUpdate AFTER UPDATE OF title, body, size ON NoteData BEGIN
+	INSERT INTO Notes (Notes, rowid, title, body) VALUES ('delete', old.id, old.title, nc_body(old.body, old.size));
+	INSERT INTO Notes (rowid, title, body) VALUES (new.id, new.title, nc_body(new.body, new.size));
+END;
+
+-- Optional, built by "grep-index on" and dropped by "grep-index off". The
+-- same text as trigrams so that grep finds runs of 3 or more characters
+-- anywhere, it is not part of the layout version
+CREATE VIRTUAL TABLE NotesTrigram USING fts5(title, body, content='NoteText', content_rowid='id', tokenize='trigram');
+INSERT INTO NotesTrigram (NotesTrigram, rank) VALUES ('automerge', 8);
+INSERT INTO NotesTrigram (NotesTrigram, rank) VALUES ('crisismerge', 32);
+INSERT INTO NotesTrigram (NotesTrigram) VALUES ('rebuild');
+CREATE TRIGGER NoteDataTrigramInsert AFTER INSERT ON NoteData BEGIN
+	INSERT INTO NotesTrigram (rowid, title, body) VALUES (new.id, new.title, nc_body(new.body, new.size));
+END;
+CREATE TRIGGER NoteDataTrigramDelete AFTER DELETE ON NoteData BEGIN
+	INSERT INTO NotesTrigram (NotesTrigram, rowid, title, body) VALUES ('delete', old.id, old.title, nc_body(old.body, old.size));
+END;
+CREATE TRIGGER NoteDataTrigramUpdate AFTER UPDATE OF title, body, size ON NoteData BEGIN
+	INSERT INTO NotesTrigram (NotesTrigram, rowid, title, body) VALUES ('delete', old.id, old.title, nc_body(old.body, old.size));
+	INSERT INTO NotesTrigram (rowid, title, body) VALUES (new.id, new.title, nc_body(new.body, new.size));
+END;
+
+-- The layout version, read from the file header on startup to pick the
+-- upgrades a database still needs (SCHEMA_VERSION in notes.c)
+PRAGMA user_version = 4;